@@ -0,0 +1,190 @@
+#ifndef __CALIBRATE__
+#define __CALIBRATE__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+
+#include <string>
+#include <vector>
+
+#include "logger.h"
+
+/*
+ * 机器速度校准
+ * 用固定的CPU、内存、IO小测试测出这台机器相对参考机器的速度系数，
+ * 时间限制乘以这个系数，使同一道题在新旧不同的机器上宽严一致。
+ *
+ * 测试结果（原始耗时）缓存在文件里，有效期内的Core进程直接读取；
+ * 同时启动的多个Core进程用flock排队，只有一个去测
+ */
+const int CALIBRATE_CPU    = 0;
+const int CALIBRATE_MEMORY = 1;
+const int CALIBRATE_IO     = 2;
+const int CALIBRATE_NUM    = 3;
+
+const int CALIBRATE_ROUNDS = 3; //每项测几次取最快的一次，减少偶然的干扰
+
+static
+double cputime_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static
+double monotonic_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+/*
+ * 整数运算、分支和乘除法
+ */
+static
+double bench_cpu() {
+    double start = cputime_ms();
+    unsigned long long x = 88172645463325252ULL, sum = 0;
+    for (int i = 0; i < 10000000; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        sum += (x & 1) ? x % 1000003 : x / 7;
+    }
+    volatile unsigned long long sink = sum;
+    (void)sink;
+    return cputime_ms() - start;
+}
+
+/*
+ * 64MB上随机的指针追逐（延迟）加两遍顺序扫描（带宽），不计构造数组的时间
+ */
+static
+double bench_memory() {
+    const size_t n = 8 << 20;
+    std::vector<size_t> next(n);
+    for (size_t i = 0; i < n; i++) next[i] = i;
+    unsigned long long seed = 1;
+    for (size_t i = n - 1; i > 0; i--) {  //Sattolo，得到一个大环
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        size_t j = (seed >> 33) % i;
+        size_t t = next[i]; next[i] = next[j]; next[j] = t;
+    }
+
+    double start = cputime_ms();
+    size_t p = 0, sum = 0;
+    for (int i = 0; i < 1000000; i++) {
+        p = next[p];
+    }
+    for (int round = 0; round < 2; round++) {
+        for (size_t i = 0; i < n; i++) sum += next[i];
+    }
+    volatile size_t sink = p + sum;
+    (void)sink;
+    return cputime_ms() - start;
+}
+
+/*
+ * 在缓存文件所在的目录写一个32MB的文件再读4遍，测的是系统调用和页缓存的速度，
+ * 评测时读写测试数据基本都落在页缓存上
+ */
+static
+double bench_io(const std::string &dir) {
+    std::string path = dir + "/calibrate.io.tmp";
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return -1;
+    }
+    unlink(path.c_str());
+    static char buf[65536];
+    memset(buf, 'x', sizeof(buf));
+
+    double start = monotonic_ms();
+    bool ok = true;
+    for (int i = 0; i < 512 && ok; i++) {
+        ok = write(fd, buf, sizeof(buf)) == (ssize_t)sizeof(buf);
+    }
+    for (int round = 0; round < 4 && ok; round++) {
+        ok = lseek(fd, 0, SEEK_SET) == 0;
+        while (ok && read(fd, buf, sizeof(buf)) > 0) {
+        }
+    }
+    double used = monotonic_ms() - start;
+    close(fd);
+    return ok ? used : -1;
+}
+
+static
+void calibrate_run(const std::string &dir, double used[CALIBRATE_NUM]) {
+    for (int i = 0; i < CALIBRATE_NUM; i++) {
+        used[i] = -1;
+    }
+    for (int round = 0; round < CALIBRATE_ROUNDS; round++) {
+        double t[CALIBRATE_NUM] = {bench_cpu(), bench_memory(), bench_io(dir)};
+        for (int i = 0; i < CALIBRATE_NUM; i++) {
+            if (t[i] >= 0 && (used[i] < 0 || t[i] < used[i])) {
+                used[i] = t[i];
+            }
+        }
+    }
+    FM_LOG_TRACE("calibrated: cpu %.1f ms, memory %.1f ms, io %.1f ms",
+            used[CALIBRATE_CPU], used[CALIBRATE_MEMORY], used[CALIBRATE_IO]);
+}
+
+/*
+ * 取这台机器的各项耗时，缓存过期或不存在时重新测
+ * 返回是否成功
+ */
+bool calibrate_host(const std::string &path, int ttl, double used[CALIBRATE_NUM]) {
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    if (flock(fd, LOCK_EX) < 0) {
+        close(fd);
+        return false;
+    }
+
+    char line[256] = {0};
+    ssize_t len = pread(fd, line, sizeof(line) - 1, 0);
+    long long stamp = 0;
+    bool cached = len > 0 &&
+        4 == sscanf(line, "%lf %lf %lf %lld", &used[0], &used[1], &used[2], &stamp) &&
+        time(NULL) - stamp < ttl;
+
+    if (!cached) {
+        size_t slash = path.rfind('/');
+        std::string dir = slash == std::string::npos ? "." : path.substr(0, slash);
+        calibrate_run(dir.empty() ? "/" : dir, used);
+        len = snprintf(line, sizeof(line), "%.3f %.3f %.3f %lld\n",
+                used[0], used[1], used[2], (long long)time(NULL));
+        if (ftruncate(fd, 0) < 0 || pwrite(fd, line, len, 0) != len) {
+            FM_LOG_WARNING("write calibration %s failed, %d: %s", path.c_str(), errno, strerror(errno));
+        }
+    }
+    close(fd);  //同时释放flock
+    return true;
+}
+
+/*
+ * 速度系数：各项耗时相对参考值之比的加权几何平均，大于1表示比参考机器慢
+ */
+double calibrate_factor(const double used[CALIBRATE_NUM], const double reference[CALIBRATE_NUM],
+        const double weight[CALIBRATE_NUM]) {
+    double log_sum = 0, weight_sum = 0;
+    for (int i = 0; i < CALIBRATE_NUM; i++) {
+        if (used[i] <= 0 || reference[i] <= 0) continue;   //测不了的项不参与
+        log_sum += weight[i] * log(used[i] / reference[i]);
+        weight_sum += weight[i];
+    }
+    return weight_sum > 0 ? exp(log_sum / weight_sum) : 1.0;
+}
+
+#endif
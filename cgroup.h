@@ -0,0 +1,104 @@
+#ifndef __CGROUP__
+#define __CGROUP__
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <string>
+
+#include "logger.h"
+
+/*
+ * cgroup v2的简单封装
+ * 管理员预先建好一个父cgroup（比如/sys/fs/cgroup/oj_core），并在它的cgroup.subtree_control里
+ * 打开memory和pids控制器；Core在下面为每次编译建一个子cgroup，用完删掉。
+ * 父cgroup不存在时调用方退回只用rlimit
+ */
+static
+bool cgroup_write(const std::string &path, const char *file, const std::string &value) {
+    std::string name = path + "/" + file;
+    int fd = open(name.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = write(fd, value.c_str(), value.size()) == (ssize_t)value.size();
+    close(fd);
+    return ok;
+}
+
+/*
+ * 在parent下建立名为name的子cgroup，返回其路径，失败返回空串
+ */
+std::string cgroup_create(const std::string &parent, const std::string &name) {
+    struct stat st;
+    if (stat(parent.c_str(), &st) < 0 || !S_ISDIR(st.st_mode)) {
+        return "";
+    }
+    std::string path = parent + "/" + name;
+    if (mkdir(path.c_str(), 0755) < 0 && errno != EEXIST) {
+        FM_LOG_WARNING("mkdir cgroup %s failed, %d: %s", path.c_str(), errno, strerror(errno));
+        return "";
+    }
+    return path;
+}
+
+bool cgroup_set(const std::string &path, const char *file, long long value) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%lld", value);
+    if (!cgroup_write(path, file, buf)) {
+        FM_LOG_WARNING("set cgroup %s/%s failed, %d: %s", path.c_str(), file, errno, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/*
+ * 把调用者自己移进cgroup，在fork出的子进程里exec之前调用
+ */
+bool cgroup_enter(const std::string &path) {
+    return cgroup_write(path, "cgroup.procs", "0");
+}
+
+/*
+ * 读*.events之类"键 值"格式文件中某个键的值，读不到返回0
+ */
+long long cgroup_event(const std::string &path, const char *file, const char *key) {
+    std::string name = path + "/" + file;
+    FILE *fp = fopen(name.c_str(), "r");
+    if (fp == NULL) {
+        return 0;
+    }
+    char k[64];
+    long long value, found = 0;
+    while (fscanf(fp, "%63s %lld", k, &value) == 2) {
+        if (strcmp(k, key) == 0) {
+            found = value;
+            break;
+        }
+    }
+    fclose(fp);
+    return found;
+}
+
+/*
+ * 杀掉cgroup里残留的进程（Linux 5.14+的cgroup.kill）并删除
+ */
+void cgroup_destroy(const std::string &path) {
+    if (path.empty()) {
+        return;
+    }
+    cgroup_write(path, "cgroup.kill", "1");
+    for (int i = 0; i < 100; i++) {
+        if (rmdir(path.c_str()) == 0 || errno == ENOENT) {
+            return;
+        }
+        usleep(1000);   //被杀的进程还没有完全退出
+    }
+    FM_LOG_WARNING("rmdir cgroup %s failed, %d: %s", path.c_str(), errno, strerror(errno));
+}
+
+#endif
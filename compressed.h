@@ -0,0 +1,143 @@
+#ifndef __COMPRESSED__
+#define __COMPRESSED__
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <string>
+
+#include "logger.h"
+
+/*
+ * 压缩的测试数据
+ * in.in/out.out不存在时依次查找in.in.zst、in.in.lz4等压缩文件，
+ * 由单独的解压进程（zstd/lz4命令）边解压边写入管道，解压后的数据不落盘。
+ * 解压进程不是用户程序的子进程，CPU时间不会算到用户头上，
+ * 并且避开用户程序所在的CPU运行
+ */
+struct compressed_format {
+    const char *suffix;
+    const char *tool;
+};
+
+static const compressed_format COMPRESSED_FORMATS[] =
+{
+    {".zst", "zstd"},
+    {".lz4", "lz4"},
+};
+const int COMPRESSED_FORMAT_NUM = sizeof(COMPRESSED_FORMATS) / sizeof(COMPRESSED_FORMATS[0]);
+
+/*
+ * 找到数据文件实际所在的路径，压缩的文件通过tool返回解压命令，未压缩时tool为NULL
+ */
+std::string resolve_data_file(const std::string &path, const char **tool) {
+    *tool = NULL;
+    if (access(path.c_str(), F_OK) == 0) {
+        return path;
+    }
+    for (int i = 0; i < COMPRESSED_FORMAT_NUM; i++) {
+        std::string compressed = path + COMPRESSED_FORMATS[i].suffix;
+        if (access(compressed.c_str(), R_OK) == 0) {
+            *tool = COMPRESSED_FORMATS[i].tool;
+            return compressed;
+        }
+    }
+    return path;
+}
+
+/*
+ * 启动解压进程，把file解压后写到out_fd，avoid不为NULL时不在其中的CPU上运行（至少留一个CPU）
+ * out_path不为NULL时由解压进程自己打开它来写（用于FIFO，打开会阻塞到有人来读）
+ */
+pid_t spawn_decompressor(const std::string &file, const char *tool, int out_fd, const cpu_set_t *avoid,
+        const char *out_path = NULL) {
+    pid_t pid = fork();
+    if (pid < 0) {
+        FM_LOG_WARNING("fork for decompressor failed, %d: %s", errno, strerror(errno));
+        return -1;
+    } else if (pid == 0) {
+        cpu_set_t mask, rest;
+        if (avoid != NULL && sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+            CPU_XOR(&rest, &mask, avoid);
+            CPU_AND(&rest, &rest, &mask);
+            if (CPU_COUNT(&rest) > 0) {
+                sched_setaffinity(0, sizeof(rest), &rest);
+            }
+        }
+        signal(SIGPIPE, SIG_DFL);   //读的一方提前退出时直接结束
+        if (out_path != NULL) {
+            out_fd = open(out_path, O_WRONLY);
+        }
+        if (out_fd < 0 || dup2(out_fd, STDOUT_FILENO) < 0) {
+            _exit(EXIT_FAILURE);
+        }
+        execlp(tool, tool, "-dcq", file.c_str(), NULL);
+        FM_LOG_WARNING("exec %s failed, %d: %s", tool, errno, strerror(errno));
+        _exit(EXIT_FAILURE);    //不能触发atexit，否则会写result.txt
+    }
+    return pid;
+}
+
+/*
+ * 结束解压进程
+ * drained为false表示不再读了（提前结束），直接杀掉；为true表示已经读到结尾，
+ * 等它退出并检查状态：找不到解压命令、数据损坏时解压进程失败，读到的数据不完整，返回false。
+ * 读的一方提前关闭管道（用户程序没读完输入）时解压进程被SIGPIPE结束，不算失败
+ */
+bool finish_decompressor(pid_t pid, bool drained = false) {
+    if (pid <= 0) {
+        return true;
+    }
+    if (!drained) {
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        return true;
+    }
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+    if (WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS) {
+        return true;
+    }
+    if (WIFSIGNALED(status) && WTERMSIG(status) == SIGPIPE) {
+        return true;
+    }
+    FM_LOG_WARNING("decompressor %d failed, status %d", (int)pid, status);
+    return false;
+}
+
+/*
+ * 打开一个可能被压缩的数据文件用于读，压缩的文件通过管道读取解压结果
+ * 用完后fclose，再用finish_decompressor结束解压进程，读到结尾时要检查它是否成功
+ */
+FILE *open_data_file(const std::string &path, pid_t &decompressor, const cpu_set_t *avoid) {
+    const char *tool;
+    std::string file = resolve_data_file(path, &tool);
+    decompressor = -1;
+    if (tool == NULL) {
+        return fopen(file.c_str(), "r");
+    }
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0) {
+        return NULL;
+    }
+    decompressor = spawn_decompressor(file, tool, fds[1], avoid);
+    close(fds[1]);
+    if (decompressor < 0) {
+        close(fds[0]);
+        return NULL;
+    }
+    return fdopen(fds[0], "r");
+}
+
+#endif
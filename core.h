@@ -2,6 +2,7 @@
 #define CORE_H
 
 #include <string>
+#include <vector>
 
 namespace JUDGE_CONF
 {
@@ -9,16 +10,96 @@ int JUDGE_TIME_LIMIT   = 15000;  //judge本身的时间限制（ms）
 
 int COMPILE_TIME_LIMIT = 10000;  //编译时间限制（ms）
 
+//编译的资源限制，超出时为编译错误
+int COMPILE_MEMORY_LIMIT  = 1024;  //每个编译进程的地址空间上限(MB)，有cgroup时同时限制所有编译进程的内存之和
+int COMPILE_CPU_LIMIT     = 10;    //每个编译进程的CPU时间上限(s)
+int COMPILE_FILE_LIMIT    = 64;    //编译写出的单个文件（可执行程序、错误信息）的大小上限(MB)
+int COMPILE_PROCESS_LIMIT = 16;    //同时存在的编译进程数上限，只在有cgroup时生效
+int COMPILE_MESSAGE_LIMIT = 64;    //编译错误信息最多保留多少(KB)
+std::string COMPILE_CGROUP = "/sys/fs/cgroup/oj_core";  //编译用的父cgroup(v2)，不存在时只用rlimit
+
 int SPJ_TIME_LIMIT     = 10000; //SpecialJudge的时间限制(MS)
 
 int STACK_SIZE_LIMIT   = 8192;  //程序运行的栈空间大小
 
 int TIME_LIMIT_ADDTION = 0;  //运行时间附加值
 
+//速度校准：参考机器上各项测试的耗时(ms)，取参考机器CALIBRATE_FILE中的前三个数
+double CALIBRATE_REFERENCE_CPU    = 65.0;
+double CALIBRATE_REFERENCE_MEMORY = 175.0;
+double CALIBRATE_REFERENCE_IO     = 22.0;
+double CALIBRATE_WEIGHT_CPU       = 0.6;  //计算速度系数时各项的权重
+double CALIBRATE_WEIGHT_MEMORY    = 0.3;
+double CALIBRATE_WEIGHT_IO        = 0.1;
+double CALIBRATE_MIN_FACTOR       = 0.5;  //速度系数的范围，防止测量异常时时限失控
+double CALIBRATE_MAX_FACTOR       = 3.0;
+int    CALIBRATE_TTL              = 86400;  //测量结果的有效期(s)
+std::string CALIBRATE_FILE = "/run/oj_core/calibration";
+
+//ptrace停顿开销的扣除
+int    OVERHEAD_TTL      = 86400;  //校准结果的有效期(s)
+double OVERHEAD_MAX_NS   = 20000;  //每次停顿开销的上限(ns)，防止测量异常时扣除过多
+int    OVERHEAD_HEADROOM = 50;     //扣除前的CPU时间可以超出时间限制多少(%)，扣除后再按时间限制判断
+std::string OVERHEAD_FILE = "/run/oj_core/overhead";
+
 int JAVA_TIME_FACTOR   = 3;  //JAVA语言的运行时间放宽倍数
 
 int JAVA_MEM_FACTOR    = 3;  //JAVA语言的运行内存放宽倍数
 
+int JAVA_WARM_TIME_FACTOR = 2;  //使用Java预热路径（CDS归档或单JVM多组运行）时的时间放宽倍数
+
+int JAVA_WARM_MEM_FACTOR  = 2;  //使用Java预热路径时的内存放宽倍数
+
+//使用Landlock时Java（不chroot）可以只读访问的路径，用冒号分隔
+std::string JAVA_READ_PATHS = "/usr:/lib:/lib64:/etc:/opt:/proc:/sys:/dev/null:/dev/zero:/dev/random:/dev/urandom";
+
+int CPU_WAIT_LIMIT     = 10000; //等待空闲CPU核心的时间上限(ms)
+
+std::string CPU_LOCK_DIR = "/run/oj_core"; //CPU核心锁文件所在目录
+
+//PSI准入控制，数值为/proc/pressure/*中some avg10的上限(%)
+double RUN_PRESSURE_CPU        = 10.0;
+double RUN_PRESSURE_MEMORY     = 5.0;
+double RUN_PRESSURE_IO         = 10.0;
+int    RUN_PRESSURE_WAIT       = 10000;  //运行前最多等待多久(ms)
+double COMPILE_PRESSURE_CPU    = 60.0;
+double COMPILE_PRESSURE_MEMORY = 30.0;
+double COMPILE_PRESSURE_IO     = 40.0;
+int    COMPILE_PRESSURE_WAIT   = 30000;  //编译前最多等待多久(ms)
+
+int CACHE_RECHECK_PERCENT  = 80; //缓存的结果用时达到时限的这个百分比（或者是TLE）时重新运行
+
+int CACHE_TRUST_BORDERLINE = 0;  //为1时信任所有缓存的结果，包括接近时限的
+
+std::string RESIDENCY_DIR = "/run/oj_core/residency"; //页缓存常驻管理的状态目录
+
+int RESIDENCY_INTERVAL = 10;  //常驻管理进程重新选择文件的间隔(s)
+
+std::string METRICS_SHM  = "/run/oj_core/metrics";      //所有Core共享的统计数据
+std::string METRICS_FILE = "/run/oj_core/metrics.prom"; //导出的Prometheus文本
+
+int TRACE_SYSCALL_SAMPLE = 64;  //时间线里每隔多少次ptrace停顿记录一次系统调用
+
+int TRACER_MAX_PRIORITY = 10;  //跟踪进程SCHED_FIFO优先级的上限，远低于内核线程
+int TRACER_RTTIME = 200000;    //实时优先级下不阻塞地连续运行的上限(us)，超出后降回普通调度
+
+int SECCOMP_POLL_INTERVAL = 10; //seccomp监控时没有通知也每隔多久(ms)检查一次内存
+int PROGRESS_INTERVAL     = 100; //ptrace跟踪时每隔多久(ms)从/proc刷新一次实时进度中的用量
+
+int NS_POOL_WAIT = 10000;   //等待空闲的命名空间的时间上限(ms)
+
+int BATCH_COMPILE_WORKERS = 2;  //批量评测时编译阶段的并发数
+
+int BATCH_RUN_WORKERS     = 1;  //批量评测时运行阶段的并发数，计时敏感，默认串行
+
+int BATCH_COMPARE_WORKERS = 1;  //批量评测时比对阶段的并发数
+
+int BATCH_COMPILE_NICE    = 10; //批量评测时编译进程的nice值，避免抢占运行阶段的CPU
+
+int STRESS_HELPER_TIME_LIMIT = 10000;  //对拍时生成器、标程每次运行的时间限制(ms)
+
+int STRESS_MAX_WORKERS = 256;   //对拍时并行的进程数上限
+
 //------------------以下是常量----------------------
 
 //OJ结果代码
@@ -56,6 +137,10 @@ const int EXIT_COMPARE          = 27;
 const int EXIT_COMPARE_SPJ      = 30;
 const int EXIT_COMPARE_SPJ_FORK = 31;
 const int EXIT_TIMEOUT          = 36;  //超时退出
+const int EXIT_BATCH_NEXT       = 40;  //批量评测中当前阶段完成，进入下一阶段
+const int EXIT_CPU_ALLOC        = 41;  //等不到空闲的CPU核心退出
+const int EXIT_PRESSURE         = 42;  //机器压力过大，需要重新排队
+const int EXIT_NS_POOL          = 43;  //等不到空闲的命名空间退出
 const int EXIT_UNKNOWN          = 127;  //不详
 
 //语言相关常量
@@ -78,21 +163,112 @@ int output_limit = 1024000; //KB，输出文件的大小限制
 int result       = JUDGE_CONF::SE; //结果代号
 int memory_usage = 0;   //内存使用量
 int time_usage    = 0;  //时间使用量
+int wall_usage    = 0;  //墙钟时间，多线程模式下和CPU时间分开统计
 std::string extra_message;  //额外信息
 std::string status;     //最终结果
 
 bool spj = false;   //是否是SpecialJudge
 
+bool calibrate = false;     //是否按机器速度缩放时间限制
+double speed_factor = 1.0;  //这台机器相对参考机器的速度系数，大于1表示更慢
+
+int threads    = 0; //大于0时为多线程模式，同时存在的线程数上限
+int wall_limit = 0; //多线程模式下的墙钟时间限制(ms)，0表示同time_limit
+
+bool overhead = false;      //是否从CPU时间中扣除ptrace停顿的开销
+double stop_cost_ns = 0;    //每次停顿的开销(ns)
+long long stops = 0;        //本次运行的停顿次数
+int raw_time_usage = 0;     //扣除之前的CPU时间
+
+bool seccomp = false;   //是否用seccomp用户通知代替ptrace监控系统调用
+
+int tracer_priority = -1;   //跟踪进程的SCHED_FIFO优先级，0表示普通调度但统计停顿延迟，-1表示不统计
+
+std::string cpu_list;   //可供用户程序独占的CPU列表，如"2-7"，为空表示不绑定CPU
+int judge_cpu = -1;     //本次运行占用的CPU
+
+bool landlock = false;  //是否用Landlock限制文件访问
+
+std::string ns_pool_dir;    //命名空间池的目录，给出后不需要root，在池里的命名空间中评测
+int ns_pool_size = 0;       //大于0时作为命名空间池的管理进程运行，值为命名空间的组数
+
+bool admission = false; //是否根据PSI做准入控制
+
+bool profile = false;   //是否统计硬件计数器
+
+int case_count = 0; //测试数据组数，0表示只有in.in/out.out一组
+
+//每组测试数据的运行结果
+struct case_result {
+    int result;
+    int time_usage;
+    int memory_usage;
+    bool ran;   //是否已经运行过
+    bool cached;    //结果是否来自缓存
+    int wall_usage;
+    bool skipped;   //提前结束时没有运行的组
+    int raw_time_usage; //扣除停顿开销之前的CPU时间
+    long long stops;    //ptrace停顿次数
+};
+std::vector<case_result> cases;
+
+//子任务：若干组测试数据和分值，这些组全部通过、依赖的子任务都得分时得到全部分值
+struct subtask {
+    int score;
+    std::vector<int> cases;     //组的下标，从0开始，一组可以属于多个子任务
+    std::vector<int> depends;   //依赖的子任务的下标，只能是前面的子任务
+};
+std::vector<subtask> subtasks;  //为空表示不按子任务计分
+
+bool metrics = false;   //是否记录整台机器的评测统计
+
+bool trace = false;     //是否导出这次评测的时间线
+std::string trace_file;         //导出的JSON
+std::string trace_buffer_file;  //记录事件的共享缓冲区
+
+bool progress = false;  //是否在运行目录下实时发布评测进度
+std::string progress_file;
+
+int sample_interval = 0;    //大于0时每隔这么多ms采样一次用户程序的资源用量
+std::string samples_file;   //采样结果，各组依次追加
+
+bool residency = false; //是否向常驻管理进程报告数据文件的访问
+int residency_budget = 0;   //大于0时作为常驻管理进程运行，值为内存预算(MB)
+std::vector<std::string> warm_dirs;  //常驻管理进程启动时预热的题目目录
+
+std::string cache_dir;  //评测结果缓存目录，为空表示不使用缓存
+
+std::string fail_stats_dir; //各组失败统计的目录，为空表示按文件顺序运行所有组
+int sample_count = 0;       //前几组是样例，总是最先按文件顺序运行
+bool first_failure = false; //提前结束时是否补跑，报告按文件顺序的第一个失败
+
+std::string report; //附加在result.txt末尾的报告，每段以[名称]开头
+
 
 std::string code_path;  //待评测的代码路径
 std::string exec_file;  //编译后生成的可执行程序路径
 std::string input_file;  //标准输入文件
+int input_fd = -1;  //输入是压缩文件时，解压结果所在管道的读端
 std::string output_file;  //标准输出文件
 std::string exec_output;  //待评测代码的输出文件
 std::string spj_exec_file;  //SpecialJudge的可执行程序
 std::string spj_output_file;  //SpecialJudge的输出文件
 std::string result_file;  //最终评判结果文件
 std::string run_dir;    //沙盒的路径，即所有运行过程所在的文件夹
+std::string subtasks_file;  //子任务配置，不存在时不按子任务计分
+std::string run_state_file;  //批量评测时运行阶段结果的暂存文件
+std::string report_state_file;  //批量评测时附加报告的暂存文件
+std::string batch_file;  //批量评测的清单文件，为空表示单次评测
+
+std::string stress_generator;   //对拍的数据生成器源代码，为空表示普通评测
+std::string stress_reference;   //对拍的标程源代码
+int stress_count   = 1000;      //对拍的组数，种子依次为1到stress_count
+int stress_workers = 0;         //对拍时并行的进程数，0表示在线的CPU数
+
+std::string java_cds_archive;  //Java类数据共享(CDS)归档，为空表示不使用
+std::string java_runner_dir;   //JudgeRunner.class所在目录，为空表示每组数据单独启动JVM
+std::string java_runner_status;  //JudgeRunner逐组输出的状态文件
+std::vector<int> java_runner_cases;  //这一批交给JudgeRunner的组（从0开始），为空时JVM直接运行Main
 
 std::string stdout_file_compiler;  //编译的输出
 std::string stderr_file_compiler;  //编译错误信息
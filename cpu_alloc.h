@@ -0,0 +1,277 @@
+#ifndef __CPU_ALLOC__
+#define __CPU_ALLOC__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sched.h>
+#include <sys/stat.h>
+
+#include <vector>
+#include <string>
+
+#include "logger.h"
+
+/*
+ * 整台机器范围内的CPU核心分配
+ * 同一台机器上的多个Core进程从配置的隔离CPU中各自占用一个物理核心
+ * （多线程模式下占用线程数上限个），用户程序固定在这些核心上运行，
+ * 不会和别的用户程序共享核心或超线程兄弟。
+ *
+ * 每个物理核心对应锁目录下的一个core<N>.lock文件（N是该核心编号最小的逻辑CPU），
+ * 用flock占用，进程退出（包括崩溃）时内核自动释放。
+ * 等待空闲核心的进程在queue.lock中取号，按号的顺序轮到的进程才去占用空闲核心，
+ * 先到先得；取号的进程退出或放弃后它的号被跳过。等待时间有上限，超时后放弃
+ */
+struct cpu_slot {
+    int cpu;    //用户程序固定到的逻辑CPU
+    int core;   //所在物理核心编号最小的逻辑CPU，作为锁的名字
+};
+
+static std::vector<cpu_slot> cpu_slots;
+static std::string cpu_lock_dir;
+static std::vector<int> cpu_lock_fds;  //占用的各个物理核心的锁
+static std::vector<int> cpu_claimed;   //占用的物理核心上用户程序可用的逻辑CPU
+
+/*
+ * 读取某个逻辑CPU所在物理核心的编号最小的逻辑CPU
+ */
+static
+int cpu_core_of(int cpu) {
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+    FILE *fp = fopen(path, "r");
+    int first = cpu;
+    if (fp != NULL) {
+        if (1 != fscanf(fp, "%d", &first)) {
+            first = cpu;
+        }
+        fclose(fp);
+    }
+    return first;
+}
+
+/*
+ * 解析形如"2,3,8-11"的CPU列表，同一物理核心只保留一个逻辑CPU
+ */
+bool cpu_alloc_init(const char *cpu_list, const char *lock_dir) {
+    cpu_slots.clear();
+    cpu_lock_dir = lock_dir;
+    const char *p = cpu_list;
+    while (*p) {
+        char *end;
+        int first = strtol(p, &end, 10), last = first;
+        if (end == p) return false;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first) return false;
+        }
+        for (int cpu = first; cpu <= last; cpu++) {
+            cpu_slot slot = {cpu, cpu_core_of(cpu)};
+            bool dup = false;
+            for (size_t i = 0; i < cpu_slots.size(); i++) {
+                dup |= (cpu_slots[i].core == slot.core);
+            }
+            if (!dup) cpu_slots.push_back(slot);
+        }
+        p = end;
+        if (*p == ',') p++;
+        else if (*p) return false;
+    }
+
+    if (mkdir(lock_dir, 0755) < 0 && errno != EEXIST) {
+        FM_LOG_WARNING("mkdir(%s) failed, %d: %s", lock_dir, errno, strerror(errno));
+        return false;
+    }
+    return !cpu_slots.empty();
+}
+
+static
+int cpu_lock_open(const std::string &name) {
+    std::string path = cpu_lock_dir + "/" + name;
+    return open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+}
+
+static
+std::string cpu_ticket_name(long long ticket) {
+    char name[64];
+    snprintf(name, sizeof(name), "ticket%lld.lock", ticket);
+    return name;
+}
+
+/*
+ * queue.lock的内容是"下一个号 正在服务的号"，读写前要持有它的flock
+ */
+static
+void cpu_queue_read(int fd, long long &next, long long &serving) {
+    char line[64] = {0};
+    next = serving = 0;
+    if (pread(fd, line, sizeof(line) - 1, 0) > 0) {
+        sscanf(line, "%lld %lld", &next, &serving);
+    }
+}
+
+static
+void cpu_queue_write(int fd, long long next, long long serving) {
+    char line[64];
+    int len = snprintf(line, sizeof(line), "%lld %lld\n", next, serving);
+    if (ftruncate(fd, 0) < 0 || pwrite(fd, line, len, 0) != len) {
+        FM_LOG_WARNING("write cpu queue failed, %d: %s", errno, strerror(errno));
+    }
+}
+
+/*
+ * 跳过已经不在排队的号：取号的进程一直持有自己的ticket<N>.lock，
+ * 能锁上说明它已经退出（包括崩溃）或者放弃了
+ */
+static
+void cpu_queue_skip_gone(long long mine, long long &serving) {
+    while (serving < mine) {
+        std::string name = cpu_ticket_name(serving);
+        int fd = cpu_lock_open(name);
+        if (fd < 0) {
+            break;
+        }
+        bool gone = flock(fd, LOCK_EX | LOCK_NB) == 0;
+        if (gone) {
+            unlink((cpu_lock_dir + "/" + name).c_str());
+        }
+        close(fd);
+        if (!gone) {
+            break;
+        }
+        serving++;
+    }
+}
+
+/*
+ * 配置的物理核心数
+ */
+int cpu_slot_count() {
+    return cpu_slots.size();
+}
+
+void cpu_release();
+
+/*
+ * 占用count个空闲的物理核心，返回用户程序应该固定到的第一个逻辑CPU，
+ * 全部的逻辑CPU见cpu_claimed_mask；wait_ms毫秒内没有等齐则全部放弃，返回-1
+ */
+int cpu_claim(int wait_ms, int count = 1) {
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    int queue_fd = cpu_lock_open("queue.lock");
+    if (queue_fd < 0) {
+        FM_LOG_WARNING("open cpu queue lock failed, %d: %s", errno, strerror(errno));
+        return -1;
+    }
+
+    //取号，持有queue.lock时就锁上自己的号，别人不会把还在等的号当成放弃了
+    long long next, serving, mine;
+    flock(queue_fd, LOCK_EX);
+    cpu_queue_read(queue_fd, next, serving);
+    mine = next;
+    int ticket_fd = cpu_lock_open(cpu_ticket_name(mine));
+    if (ticket_fd < 0 || flock(ticket_fd, LOCK_EX) < 0) {
+        FM_LOG_WARNING("open cpu queue ticket failed, %d: %s", errno, strerror(errno));
+        if (ticket_fd >= 0) close(ticket_fd);
+        flock(queue_fd, LOCK_UN);
+        close(queue_fd);
+        return -1;
+    }
+    cpu_queue_write(queue_fd, next + 1, serving);
+    flock(queue_fd, LOCK_UN);
+
+    //按号的顺序服务：轮到自己时轮询直到空出足够的核心，已经占到的核心不会被排在后面的抢走
+    std::vector<bool> held(cpu_slots.size(), false);
+    bool done = false;
+    while (!done) {
+        flock(queue_fd, LOCK_EX);
+        cpu_queue_read(queue_fd, next, serving);
+        cpu_queue_skip_gone(mine, serving);
+        for (size_t i = 0; serving == mine && i < cpu_slots.size() && (int)cpu_claimed.size() < count; i++) {
+            if (held[i]) continue;
+            char name[64];
+            snprintf(name, sizeof(name), "core%d.lock", cpu_slots[i].core);
+            int fd = cpu_lock_open(name);
+            if (fd >= 0 && flock(fd, LOCK_EX | LOCK_NB) == 0) {
+                cpu_lock_fds.push_back(fd);
+                cpu_claimed.push_back(cpu_slots[i].cpu);
+                held[i] = true;
+            } else if (fd >= 0) {
+                close(fd);
+            }
+        }
+        done = (int)cpu_claimed.size() >= count;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long elapsed = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
+        if (!done && elapsed >= wait_ms) {
+            FM_LOG_WARNING("no %d free cpu cores in %d ms, ticket %lld, serving %lld", count, wait_ms, mine, serving);
+            cpu_release();
+        }
+        if (done || elapsed >= wait_ms) {
+            //不论占到还是放弃，都让下一个号接着
+            if (serving == mine) {
+                serving++;
+            }
+            unlink((cpu_lock_dir + "/" + cpu_ticket_name(mine)).c_str());
+            done = true;
+        }
+        cpu_queue_write(queue_fd, next, serving);
+        flock(queue_fd, LOCK_UN);
+        if (!done) {
+            usleep(1000);
+        }
+    }
+
+    close(ticket_fd);
+    close(queue_fd);
+    return cpu_claimed.empty() ? -1 : cpu_claimed[0];
+}
+
+/*
+ * 从mask中去掉配置的物理核心上的CPU（包括超线程兄弟），剩下的CPU不会和任何用户程序共享物理核心
+ */
+void cpu_clear_slots(cpu_set_t &mask) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &mask)) continue;
+        int core = cpu_core_of(cpu);
+        for (size_t i = 0; i < cpu_slots.size(); i++) {
+            if (cpu_slots[i].core == core) {
+                CPU_CLR(cpu, &mask);
+                break;
+            }
+        }
+    }
+}
+
+/*
+ * 占用的所有逻辑CPU
+ */
+void cpu_claimed_mask(cpu_set_t &mask) {
+    CPU_ZERO(&mask);
+    for (size_t i = 0; i < cpu_claimed.size(); i++) {
+        CPU_SET(cpu_claimed[i], &mask);
+    }
+}
+
+/*
+ * 释放占用的物理核心
+ */
+void cpu_release() {
+    for (size_t i = 0; i < cpu_lock_fds.size(); i++) {
+        close(cpu_lock_fds[i]);
+    }
+    cpu_lock_fds.clear();
+    cpu_claimed.clear();
+}
+
+#endif
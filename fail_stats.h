@@ -0,0 +1,124 @@
+#ifndef __FAIL_STATS__
+#define __FAIL_STATS__
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+
+#include <string>
+#include <vector>
+
+#include "logger.h"
+#include "verdict_cache.h"
+
+/*
+ * 每道题各组测试数据的失败统计
+ * 错误的提交大多死在同样几组数据上，按失败概率从高到低运行，遇到第一个非AC就可以停下。
+ *
+ * 题目由各组标准输出的哈希确定，每道题一个文件，第一行是组数，之后每行是一组的
+ * "运行次数 失败次数"。多个Core进程用flock串行地读改写
+ */
+struct case_stat {
+    long long runs;
+    long long fails;
+};
+
+static std::string fail_stats_dir;
+
+bool fail_stats_init(const std::string &dir) {
+    fail_stats_dir = dir;
+    //没有结果缓存目录时，标准输出的哈希记忆在统计目录下，不必每次重新哈希所有数据
+    if (cache_dir.empty()) {
+        return hash_memo_init(dir);
+    }
+    return make_dirs(dir);
+}
+
+static
+std::string fail_stats_path(cache_hash problem) {
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx", (unsigned long long)problem);
+    return fail_stats_dir + name;
+}
+
+/*
+ * 从已经加锁的文件中读出n组的统计，组数对不上时当作没有统计
+ */
+static
+void fail_stats_read_fd(int fd, std::vector<case_stat> &stats) {
+    for (size_t i = 0; i < stats.size(); i++) {
+        stats[i].runs = stats[i].fails = 0;
+    }
+    FILE *fp = fdopen(dup(fd), "r");
+    if (fp == NULL) {
+        return;
+    }
+    int n = 0;
+    if (1 == fscanf(fp, "%d", &n) && n == (int)stats.size()) {
+        for (int i = 0; i < n; i++) {
+            if (2 != fscanf(fp, "%lld %lld", &stats[i].runs, &stats[i].fails)) {
+                stats[i].runs = stats[i].fails = 0;
+                break;
+            }
+        }
+    }
+    fclose(fp);
+}
+
+/*
+ * 读出这道题n组数据的统计
+ */
+void fail_stats_get(cache_hash problem, std::vector<case_stat> &stats) {
+    for (size_t i = 0; i < stats.size(); i++) {
+        stats[i].runs = stats[i].fails = 0;
+    }
+    int fd = open(fail_stats_path(problem).c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    if (flock(fd, LOCK_SH) == 0) {
+        fail_stats_read_fd(fd, stats);
+    }
+    close(fd);
+}
+
+/*
+ * 把这次评测的结果累加到统计中
+ */
+void fail_stats_add(cache_hash problem, const std::vector<case_stat> &delta) {
+    std::string path = fail_stats_path(problem);
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0 || flock(fd, LOCK_EX) < 0) {
+        FM_LOG_WARNING("Cannot update fail stats %s, %d: %s", path.c_str(), errno, strerror(errno));
+        if (fd >= 0) close(fd);
+        return;
+    }
+    std::vector<case_stat> stats(delta.size());
+    fail_stats_read_fd(fd, stats);
+
+    std::string content;
+    char line[64];
+    snprintf(line, sizeof(line), "%d\n", (int)stats.size());
+    content += line;
+    for (size_t i = 0; i < stats.size(); i++) {
+        snprintf(line, sizeof(line), "%lld %lld\n",
+                stats[i].runs + delta[i].runs, stats[i].fails + delta[i].fails);
+        content += line;
+    }
+    if (ftruncate(fd, 0) < 0 || pwrite(fd, content.c_str(), content.size(), 0) != (ssize_t)content.size()) {
+        FM_LOG_WARNING("write fail stats %s failed, %d: %s", path.c_str(), errno, strerror(errno));
+    }
+    close(fd);  //同时释放flock
+}
+
+/*
+ * 失败概率的估计，加一平滑，没有统计的组排在中间
+ */
+double fail_rate(const case_stat &s) {
+    return (s.fails + 1.0) / (s.runs + 2.0);
+}
+
+#endif
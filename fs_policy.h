@@ -0,0 +1,145 @@
+#ifndef __FS_POLICY__
+#define __FS_POLICY__
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/landlock.h>
+
+#include <string>
+#include <vector>
+
+#include "logger.h"
+
+/*
+ * 用Landlock限制用户程序能访问的文件
+ * 在子进程exec之前生效，之后由内核检查每一次打开文件，
+ * 不再需要在ptrace的open停顿里逐字读出路径来判断
+ *
+ * 只读：沙盒目录以及运行时需要的路径（Java需要JDK、/etc等）
+ * 可写：用户程序的输出文件（JudgeRunner还需要在沙盒里创建各组的输出）
+ */
+//较老的头文件里没有ABI 3、5新加的权限
+#ifndef LANDLOCK_ACCESS_FS_TRUNCATE
+#define LANDLOCK_ACCESS_FS_TRUNCATE (1ULL << 14)
+#endif
+#ifndef LANDLOCK_ACCESS_FS_IOCTL_DEV
+#define LANDLOCK_ACCESS_FS_IOCTL_DEV (1ULL << 15)
+#endif
+
+const __u64 FS_READ  = LANDLOCK_ACCESS_FS_EXECUTE | LANDLOCK_ACCESS_FS_READ_FILE |
+                       LANDLOCK_ACCESS_FS_READ_DIR;
+const __u64 FS_WRITE = LANDLOCK_ACCESS_FS_WRITE_FILE | LANDLOCK_ACCESS_FS_MAKE_REG |
+                       LANDLOCK_ACCESS_FS_TRUNCATE;
+//普通文件上只能设置这些权限，不能有目录相关的
+const __u64 FS_FILE_ACCESS = LANDLOCK_ACCESS_FS_EXECUTE | LANDLOCK_ACCESS_FS_READ_FILE |
+                             LANDLOCK_ACCESS_FS_WRITE_FILE | LANDLOCK_ACCESS_FS_TRUNCATE |
+                             LANDLOCK_ACCESS_FS_IOCTL_DEV;
+
+struct fs_rule {
+    std::string path;
+    __u64 access;
+    bool required;  //不存在时是否算作失败
+};
+
+/*
+ * 内核支持的Landlock ABI版本，不支持时返回0
+ */
+int landlock_abi() {
+    long abi = syscall(__NR_landlock_create_ruleset, NULL, 0, LANDLOCK_CREATE_RULESET_VERSION);
+    return abi < 0 ? 0 : (int)abi;
+}
+
+/*
+ * 内核按这个ABI版本能管理的全部权限，没有管理的权限不受限制
+ */
+__u64 landlock_handled_access(int abi) {
+    //ABI 1 管理REFER之前的所有权限，ABI 2 加上REFER，ABI 3 加上TRUNCATE，ABI 5 加上IOCTL_DEV
+    __u64 handled = LANDLOCK_ACCESS_FS_REFER - 1;
+    if (abi >= 2) handled |= LANDLOCK_ACCESS_FS_REFER;
+    if (abi >= 3) handled |= LANDLOCK_ACCESS_FS_TRUNCATE;
+    if (abi >= 5) handled |= LANDLOCK_ACCESS_FS_IOCTL_DEV;
+    return handled;
+}
+
+/*
+ * 把路径解析成绝对路径后加入规则：相对路径和符号链接要在chdir、chroot之前解析
+ * 不存在的路径，必需的返回false，可选的跳过（比如有的系统没有/lib64）
+ */
+bool fs_rule_add(std::vector<fs_rule> &rules, const std::string &path, __u64 access, bool required) {
+    char *real = realpath(path.c_str(), NULL);
+    if (real == NULL) {
+        if (required) {
+            FM_LOG_WARNING("realpath(%s) failed, %d: %s", path.c_str(), errno, strerror(errno));
+        }
+        return !required;
+    }
+    fs_rule rule = {real, access, required};
+    rules.push_back(rule);
+    free(real);
+    return true;
+}
+
+/*
+ * 建立规则集并限制当前进程，之后exec的程序也受限
+ * 不存在的可选路径直接跳过，必需的路径不存在时失败
+ */
+bool fs_policy_apply(const std::vector<fs_rule> &rules) {
+    int abi = landlock_abi();
+    if (abi < 1) {
+        FM_LOG_WARNING("Landlock is not supported by this kernel");
+        return false;
+    }
+
+    struct landlock_ruleset_attr ruleset_attr;
+    memset(&ruleset_attr, 0, sizeof(ruleset_attr));
+    ruleset_attr.handled_access_fs = landlock_handled_access(abi);
+
+    int ruleset = syscall(__NR_landlock_create_ruleset, &ruleset_attr, sizeof(ruleset_attr), 0);
+    if (ruleset < 0) {
+        FM_LOG_WARNING("landlock_create_ruleset failed, %d: %s", errno, strerror(errno));
+        return false;
+    }
+
+    for (size_t i = 0; i < rules.size(); i++) {
+        int fd = open(rules[i].path.c_str(), O_PATH | O_CLOEXEC);
+        if (fd < 0 && rules[i].required) {
+            FM_LOG_WARNING("open(%s) for landlock failed, %d: %s", rules[i].path.c_str(), errno, strerror(errno));
+            close(ruleset);
+            return false;
+        } else if (fd < 0) {
+            continue;
+        }
+        struct stat st;
+        struct landlock_path_beneath_attr attr;
+        attr.allowed_access = rules[i].access & ruleset_attr.handled_access_fs;
+        attr.parent_fd = fd;
+        if (fstat(fd, &st) == 0 && !S_ISDIR(st.st_mode)) {
+            attr.allowed_access &= FS_FILE_ACCESS;
+        }
+        if (syscall(__NR_landlock_add_rule, ruleset, LANDLOCK_RULE_PATH_BENEATH, &attr, 0) < 0) {
+            FM_LOG_WARNING("landlock_add_rule(%s) failed, %d: %s", rules[i].path.c_str(), errno, strerror(errno));
+            close(fd);
+            close(ruleset);
+            return false;
+        }
+        close(fd);
+    }
+
+    //不提权是限制自己的前提，setuid之后也没有别的办法
+    if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) < 0 ||
+        syscall(__NR_landlock_restrict_self, ruleset, 0) < 0) {
+        FM_LOG_WARNING("landlock_restrict_self failed, %d: %s", errno, strerror(errno));
+        close(ruleset);
+        return false;
+    }
+    close(ruleset);
+    return true;
+}
+
+#endif
@@ -0,0 +1,369 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <unistd.h>
+#include <errno.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/landlock.h>
+
+#include "logger.h"
+#include "seccomp_notify.h"
+
+/*
+ * 对比不同的限制手段（配置）下评测结果是否一致，以及时间、内存、评测开销的差别
+ *
+ * 语料目录下每个子目录是一个历史提交：
+ *   submission.txt  源代码文件名 [时间限制 [内存限制 [SpecialJudge语言 [测试数据组数]]]]
+ *   expected.txt    线上评测时的result.txt
+ *   源代码、测试数据以及SpecialJudge等其他文件
+ *
+ * 每个提交在每种配置下复制到临时目录里用Core评测一次，和expected.txt比较
+ */
+
+struct harness_config {
+    std::string name;
+    std::vector<std::string> args;  //附加给Core的参数
+};
+
+struct submission {
+    std::string name;
+    std::string dir;
+    std::string code;
+    int time_limit;
+    int memory_limit;
+    int spj_lang;
+    int case_count;
+    std::string verdict;    //线上记录的结果
+    int time_usage;
+    int memory_usage;
+};
+
+struct config_stats {
+    int runs;
+    int mismatches;
+    int failures;           //Core没有写出结果
+    double time_delta_sum;  //和线上记录的差的绝对值
+    int time_delta_max;
+    double memory_delta_sum;
+    int memory_delta_max;
+    double wall_sum;        //Core从启动到退出的时间(ms)
+    double cpu_sum;         //Core自身及其子进程的CPU时间减去用户程序时间(ms)
+};
+
+static std::string core_path = "./Core";
+static std::string corpus_dir;
+static std::string scratch_dir = "/tmp/oj_harness";
+static std::vector<harness_config> configs;
+
+/*
+ * 按空白拆分参数
+ */
+static
+std::vector<std::string> split_args(const char *s) {
+    std::vector<std::string> args;
+    char buf[1024];
+    int off = 0, n = 0;
+    while (sscanf(s + off, "%1023s%n", buf, &n) == 1) {
+        args.push_back(buf);
+        off += n;
+    }
+    return args;
+}
+
+/*
+ * 默认的配置：只用ptrace检查，以及内核支持时再加上Landlock、改用seccomp监控
+ */
+static
+void default_configs() {
+    harness_config ptrace_only;
+    ptrace_only.name = "ptrace";
+    configs.push_back(ptrace_only);
+
+    if (syscall(SYS_landlock_create_ruleset, NULL, 0, LANDLOCK_CREATE_RULESET_VERSION) > 0) {
+        harness_config landlock;
+        landlock.name = "landlock";
+        landlock.args.push_back("-L");
+        configs.push_back(landlock);
+    }
+
+    if (seccomp_notify_available()) {
+        harness_config seccomp;
+        seccomp.name = "seccomp";
+        seccomp.args.push_back("-q");
+        configs.push_back(seccomp);
+    }
+}
+
+/*
+ * 读取一个result.txt格式的文件：结果、时间、内存
+ */
+static
+bool read_result(const std::string &path, std::string &verdict, int &time_usage, int &memory_usage) {
+    FILE *fp = fopen(path.c_str(), "r");
+    if (fp == NULL) {
+        return false;
+    }
+    char line[256];
+    bool ok = fgets(line, sizeof(line), fp) != NULL;
+    if (ok) {
+        line[strcspn(line, "\n")] = 0;
+        verdict = line;
+        if (2 != fscanf(fp, "%d %d", &time_usage, &memory_usage)) {
+            time_usage = memory_usage = 0;
+        }
+    }
+    fclose(fp);
+    return ok;
+}
+
+static
+void read_corpus(std::vector<submission> &subs) {
+    DIR *dir = opendir(corpus_dir.c_str());
+    if (dir == NULL) {
+        FM_LOG_FATAL("Open corpus %s failed, %d: %s", corpus_dir.c_str(), errno, strerror(errno));
+        exit(1);
+    }
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (ent->d_name[0] == '.') continue;
+        submission s;
+        s.name = ent->d_name;
+        s.dir = corpus_dir + "/" + ent->d_name;
+        s.time_limit = 1000;
+        s.memory_limit = 65535;
+        s.spj_lang = 0;
+        s.case_count = 0;
+
+        std::string meta = s.dir + "/submission.txt";
+        FILE *fp = fopen(meta.c_str(), "r");
+        if (fp == NULL) continue;
+        char code[1024];
+        int n = fscanf(fp, "%1023s %d %d %d %d", code,
+                &s.time_limit, &s.memory_limit, &s.spj_lang, &s.case_count);
+        fclose(fp);
+        if (n < 1) {
+            FM_LOG_WARNING("Bad submission.txt in %s", s.dir.c_str());
+            continue;
+        }
+        s.code = code;
+        if (!read_result(s.dir + "/expected.txt", s.verdict, s.time_usage, s.memory_usage)) {
+            FM_LOG_WARNING("No expected.txt in %s", s.dir.c_str());
+            continue;
+        }
+        subs.push_back(s);
+    }
+    closedir(dir);
+}
+
+/*
+ * 运行一个子进程并等待，返回它的退出状态，rused为它及其子进程的资源消耗
+ */
+static
+int run_command(const std::vector<std::string> &args, const std::string &cwd, struct rusage *rused) {
+    pid_t pid = fork();
+    if (pid < 0) {
+        FM_LOG_FATAL("fork failed, %d: %s", errno, strerror(errno));
+        exit(1);
+    } else if (pid == 0) {
+        if (!cwd.empty() && chdir(cwd.c_str()) < 0) {
+            _exit(127);
+        }
+        std::vector<char *> argv;
+        for (size_t i = 0; i < args.size(); i++) {
+            argv.push_back(const_cast<char *>(args[i].c_str()));
+        }
+        argv.push_back(NULL);
+        execvp(argv[0], &argv[0]);
+        _exit(127);
+    }
+    int status = 0;
+    struct rusage dummy;
+    if (wait4(pid, &status, 0, rused ? rused : &dummy) < 0) {
+        FM_LOG_FATAL("wait4 failed, %d: %s", errno, strerror(errno));
+        exit(1);
+    }
+    return status;
+}
+
+static
+double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+/*
+ * 在一种配置下评测一个提交
+ */
+static
+void judge_submission(const harness_config &conf, const submission &s, config_stats &st) {
+    std::string work = scratch_dir + "/" + conf.name + "/" + s.name;
+    std::vector<std::string> cmd;
+    cmd.push_back("rm");
+    cmd.push_back("-rf");
+    cmd.push_back(work);
+    run_command(cmd, "", NULL);
+    cmd.clear();
+    cmd.push_back("cp");
+    cmd.push_back("-a");
+    cmd.push_back(s.dir);
+    cmd.push_back(work);
+    if (run_command(cmd, "", NULL) != 0) {
+        FM_LOG_FATAL("Copy %s to %s failed", s.dir.c_str(), work.c_str());
+        exit(1);
+    }
+    unlink((work + "/result.txt").c_str());
+
+    char num[32];
+    cmd.clear();
+    cmd.push_back(core_path);
+    cmd.push_back("-c");
+    cmd.push_back(work + "/" + s.code);
+    cmd.push_back("-d");
+    cmd.push_back(work);
+    snprintf(num, sizeof(num), "%d", s.time_limit);
+    cmd.push_back("-t");
+    cmd.push_back(num);
+    snprintf(num, sizeof(num), "%d", s.memory_limit);
+    cmd.push_back("-m");
+    cmd.push_back(num);
+    if (s.spj_lang) {
+        snprintf(num, sizeof(num), "%d", s.spj_lang);
+        cmd.push_back("-s");
+        cmd.push_back("-S");
+        cmd.push_back(num);
+    }
+    if (s.case_count) {
+        snprintf(num, sizeof(num), "%d", s.case_count);
+        cmd.push_back("-n");
+        cmd.push_back(num);
+    }
+    cmd.insert(cmd.end(), conf.args.begin(), conf.args.end());
+
+    struct rusage rused;
+    double start = now_ms();
+    run_command(cmd, work, &rused);
+    double wall = now_ms() - start;
+
+    st.runs++;
+    std::string verdict;
+    int time_usage = 0, memory_usage = 0;
+    if (!read_result(work + "/result.txt", verdict, time_usage, memory_usage)) {
+        st.failures++;
+        printf("FAILED\t%s\t%s\n", conf.name.c_str(), s.name.c_str());
+        return;
+    }
+    if (verdict != s.verdict) {
+        st.mismatches++;
+        printf("MISMATCH\t%s\t%s\t%s\t%s\n", conf.name.c_str(), s.name.c_str(),
+                s.verdict.c_str(), verdict.c_str());
+    }
+    int dt = abs(time_usage - s.time_usage);
+    int dm = abs(memory_usage - s.memory_usage);
+    st.time_delta_sum += dt;
+    st.time_delta_max = std::max(st.time_delta_max, dt);
+    st.memory_delta_sum += dm;
+    st.memory_delta_max = std::max(st.memory_delta_max, dm);
+    st.wall_sum += wall;
+    double cpu = rused.ru_utime.tv_sec * 1000.0 + rused.ru_utime.tv_usec / 1000.0 +
+                 rused.ru_stime.tv_sec * 1000.0 + rused.ru_stime.tv_usec / 1000.0;
+    st.cpu_sum += cpu - time_usage;
+}
+
+static
+void print_usage() {
+    fprintf(stderr, "usage: Harness -d corpus [-c core] [-w scratch] [-x name=\"core args\"]...\n");
+}
+
+int main(int argc, char *argv[]) {
+    log_open("./harness_log.txt");
+
+    int opt;
+    while ((opt = getopt(argc, argv, "d:c:w:x:")) != -1) {
+        switch (opt) {
+            case 'd': corpus_dir  = optarg; break;
+            case 'c': core_path   = optarg; break;
+            case 'w': scratch_dir = optarg; break;
+            case 'x': {
+                harness_config conf;
+                const char *eq = strchr(optarg, '=');
+                conf.name = eq ? std::string(optarg, eq - optarg) : optarg;
+                if (eq) conf.args = split_args(eq + 1);
+                configs.push_back(conf);
+                break;
+            }
+            default:
+                print_usage();
+                return 1;
+        }
+    }
+    if (corpus_dir.empty()) {
+        print_usage();
+        return 1;
+    }
+    if (configs.empty()) {
+        default_configs();
+    }
+
+    //Core在沙盒里运行，路径要是绝对的
+    char real[PATH_MAX];
+    if (realpath(core_path.c_str(), real) == NULL) {
+        FM_LOG_FATAL("Bad Core path %s, %d: %s", core_path.c_str(), errno, strerror(errno));
+        return 1;
+    }
+    core_path = real;
+    if (realpath(corpus_dir.c_str(), real) == NULL) {
+        FM_LOG_FATAL("Bad corpus path %s, %d: %s", corpus_dir.c_str(), errno, strerror(errno));
+        return 1;
+    }
+    corpus_dir = real;
+
+    std::vector<submission> subs;
+    read_corpus(subs);
+    FM_LOG_TRACE("%d submissions, %d configs", (int)subs.size(), (int)configs.size());
+
+    std::vector<config_stats> stats(configs.size());
+    for (size_t c = 0; c < configs.size(); c++) {
+        memset(&stats[c], 0, sizeof(config_stats));
+        mkdir(scratch_dir.c_str(), 0755);
+        mkdir((scratch_dir + "/" + configs[c].name).c_str(), 0755);
+    }
+    //按提交交替运行各配置，机器负载的波动平均分摊到每个配置上
+    for (size_t i = 0; i < subs.size(); i++) {
+        for (size_t c = 0; c < configs.size(); c++) {
+            judge_submission(configs[c], subs[i], stats[c]);
+        }
+    }
+
+    printf("#config\truns\tmismatch\tfailed\ttime_delta_avg\ttime_delta_max\t"
+           "memory_delta_avg\tmemory_delta_max\twall_avg\toverhead_avg\toverhead_vs_%s\n",
+           configs[0].name.c_str());
+    for (size_t c = 0; c < configs.size(); c++) {
+        const config_stats &st = stats[c];
+        int n = std::max(st.runs, 1);
+        printf("%s\t%d\t%d\t%d\t%.1f\t%d\t%.1f\t%d\t%.1f\t%.1f\t%+.1f\n",
+                configs[c].name.c_str(), st.runs, st.mismatches, st.failures,
+                st.time_delta_sum / n, st.time_delta_max,
+                st.memory_delta_sum / n, st.memory_delta_max,
+                st.wall_sum / n, st.cpu_sum / n,
+                (st.cpu_sum - stats[0].cpu_sum) / n);
+    }
+
+    int bad = 0;
+    for (size_t c = 0; c < configs.size(); c++) {
+        bad += stats[c].mismatches + stats[c].failures;
+    }
+    return bad ? 2 : 0;
+}
@@ -0,0 +1,91 @@
+import java.io.*;
+import java.lang.management.*;
+import java.lang.reflect.*;
+import java.net.*;
+
+/*
+ * 在同一个JVM里依次运行多组测试数据，JVM启动的开销只付一次
+ *
+ * 用法: java -cp <JudgeRunner所在目录> JudgeRunner <状态文件> <时间限制(ms)> <序号> <输入> <输出> [<序号> <输入> <输出> ...]
+ *
+ * 每组数据用新的ClassLoader加载Main，用户类的静态变量不会残留到下一组，
+ * System.in/System.out也会重新指向这一组的输入输出文件。
+ * 每组结束后向状态文件写一行: 序号 OK|RE|TLE CPU时间(ms) 堆内存峰值(KB)
+ * CPU时间是整个JVM进程的，包括GC、JIT和用户创建的线程。
+ * 一组的CPU时间或墙钟时间超过限制时，看门狗线程写出TLE并立即结束JVM。
+ * 用户代码调用System.exit会结束整个JVM，没有写出状态的组由Core单独重跑
+ */
+public class JudgeRunner {
+    private static volatile String current;     //正在运行的组的序号
+    private static volatile long cpuStart;      //这一组开始时进程的CPU时间(ns)
+    private static volatile long wallStart;     //这一组开始时的墙钟时间(ns)
+
+    public static void main(String[] args) throws Exception {
+        PrintWriter status = new PrintWriter(new FileWriter(args[0]), true);
+        com.sun.management.OperatingSystemMXBean os =
+            (com.sun.management.OperatingSystemMXBean) ManagementFactory.getOperatingSystemMXBean();
+        long limit = Long.parseLong(args[1]) * 1000000;
+        URL[] classpath = { new File(".").toURI().toURL() };
+
+        Thread watchdog = new Thread(() -> {
+            while (true) {
+                try {
+                    Thread.sleep(10);
+                } catch (InterruptedException e) {
+                    return;
+                }
+                String id = current;
+                long cpu = os.getProcessCpuTime() - cpuStart;
+                if (id != null && (cpu > limit || System.nanoTime() - wallStart > limit)) {
+                    synchronized (status) {
+                        status.println(id + " TLE " + cpu / 1000000 + " 0");
+                    }
+                    Runtime.getRuntime().halt(0);
+                }
+            }
+        });
+        watchdog.setDaemon(true);
+        watchdog.start();
+
+        for (int i = 2; i + 2 < args.length; i += 3) {
+            InputStream in = new BufferedInputStream(new FileInputStream(args[i + 1]));
+            PrintStream out = new PrintStream(new BufferedOutputStream(new FileOutputStream(args[i + 2])), false);
+            System.setIn(in);
+            System.setOut(out);
+
+            System.gc();
+            for (MemoryPoolMXBean pool : ManagementFactory.getMemoryPoolMXBeans()) {
+                pool.resetPeakUsage();
+            }
+
+            String verdict = "OK";
+            cpuStart = os.getProcessCpuTime();
+            wallStart = System.nanoTime();
+            current = args[i];
+            try (URLClassLoader loader = new URLClassLoader(classpath, ClassLoader.getPlatformClassLoader())) {
+                Method main = loader.loadClass("Main").getMethod("main", String[].class);
+                main.invoke(null, (Object) new String[0]);
+            } catch (InvocationTargetException e) {
+                e.getCause().printStackTrace();
+                verdict = "RE";
+            }
+            current = null;
+            long cpu = (os.getProcessCpuTime() - cpuStart) / 1000000;
+
+            long heap = 0;
+            for (MemoryPoolMXBean pool : ManagementFactory.getMemoryPoolMXBeans()) {
+                if (pool.getType() == MemoryType.HEAP) {
+                    heap += pool.getPeakUsage().getUsed();
+                }
+            }
+
+            out.flush();
+            out.close();
+            in.close();
+            synchronized (status) {
+                status.println(args[i] + " " + verdict + " " + cpu + " " + heap / 1024);
+            }
+        }
+        status.close();
+    }
+}
@@ -0,0 +1,3578 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <algorithm>
+
+#include <unistd.h>
+#include <errno.h>
+#include <sched.h>
+#include <pwd.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <sys/reg.h>
+#include <sys/user.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <sys/ptrace.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <spawn.h>
+
+#include "libjudge.h"
+#include "core.h"
+#include "logger.h"
+#include "perf_profile.h"
+#include "cpu_alloc.h"
+#include "pressure.h"
+#include "verdict_cache.h"
+#include "fs_policy.h"
+#include "compressed.h"
+#include "residency.h"
+#include "metrics.h"
+#include "trace.h"
+#include "calibrate.h"
+#include "overhead.h"
+#include "fail_stats.h"
+#include "progress.h"
+#include "sampler.h"
+#include "nspool.h"
+#include "cgroup.h"
+#include "seccomp_notify.h"
+
+extern int errno;
+
+/*
+ * 判断某字符串是否含有某后缀
+ */
+static
+bool has_suffix(const std::string &str, const std::string &suffix) {
+    return str.size() >= suffix.size() &&
+           str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+static judge_result *shared_result = NULL;  //judge_run评测时交回结果的共享内存
+const int JUDGE_RESULT_FD = 3;  //judge_run启动的Core在这个fd上找到共享内存，见LIBJUDGE_RESULT_FD
+
+/*
+ * 输出判题结果到结果文件
+ */
+static
+void output_result() {
+    if (PROBLEM::result_file.empty()) {
+        return; //批量评测的调度进程自身没有结果
+    }
+    trace_begin("result");
+    FILE* result_file = fopen(PROBLEM::result_file.c_str(), "w");
+    switch (PROBLEM::result){
+        case 1:PROBLEM::status = "Compile Error";break;
+        case 2:PROBLEM::status = "Time Limit Exceeded";break;
+        case 3:PROBLEM::status = "Memory Limit Exceeded";break;
+        case 4:PROBLEM::status = "Output Limit Exceeded";break;
+        case 5:PROBLEM::status = "Runtime Error";break;
+        case 6:PROBLEM::status = "Wrong Answer";break;
+        case 7:PROBLEM::status = "Accepted";break;
+        case 8:PROBLEM::status = "Presentation Error";break;
+        default:PROBLEM::status = "System Error";break;
+    }
+    if (result_file != NULL) {
+        fprintf(result_file, "%s\n", PROBLEM::status.c_str());
+        fprintf(result_file, "%d\n", PROBLEM::time_usage);
+        fprintf(result_file, "%d\n", PROBLEM::memory_usage);
+        fprintf(result_file, "%s\n", PROBLEM::extra_message.c_str());
+        fprintf(result_file, "%s", PROBLEM::report.c_str());
+    } else {
+        //比如运行目录不存在，通过judge_run评测时结果仍然能交回
+        FM_LOG_WARNING("Cannot write %s, %d: %s", PROBLEM::result_file.c_str(), errno, strerror(errno));
+    }
+
+    if (shared_result != NULL) {
+        shared_result->result = PROBLEM::result;
+        shared_result->time_usage = PROBLEM::time_usage;
+        shared_result->memory_usage = PROBLEM::memory_usage;
+        snprintf(shared_result->status, sizeof(shared_result->status), "%s", PROBLEM::status.c_str());
+        snprintf(shared_result->extra_message, sizeof(shared_result->extra_message),
+                "%s", PROBLEM::extra_message.c_str());
+    }
+
+    FM_LOG_TRACE("The final result is %s %d %d %s",
+            PROBLEM::status.c_str(), PROBLEM::time_usage,
+            PROBLEM::memory_usage, PROBLEM::extra_message.c_str());
+    progress_done(PROBLEM::result, PROBLEM::time_usage, PROBLEM::memory_usage);
+    trace_end("result");
+}
+
+/*
+ * 评测进程退出时导出时间线，在output_result之后执行
+ */
+static
+void output_trace() {
+    if (PROBLEM::result_file.empty()) {
+        return;
+    }
+    trace_export(PROBLEM::trace_file, PROBLEM::trace_buffer_file);
+}
+
+/*
+ * 开始记录时间线，reset为false时接着之前阶段的记录
+ */
+static
+void start_trace(bool reset) {
+    if (PROBLEM::trace && !trace_init(PROBLEM::trace_buffer_file, reset)) {
+        FM_LOG_WARNING("Cannot map trace buffer %s, %d: %s",
+                PROBLEM::trace_buffer_file.c_str(), errno, strerror(errno));
+    }
+}
+
+static pid_t main_pid;  //最初的Core进程，在命名空间池中评测时阶段进程看不到它的pid
+
+/*
+ * 开始发布评测进度，reset为false时接着之前阶段的记录
+ * 批量评测时各阶段进程依次退出，读者通过调度进程判断评测是否还在进行
+ */
+static
+void start_progress(bool reset) {
+    if (PROBLEM::progress && !progress_init(PROBLEM::progress_file, reset, main_pid)) {
+        FM_LOG_WARNING("Cannot map progress %s, %d: %s",
+                PROBLEM::progress_file.c_str(), errno, strerror(errno));
+    }
+}
+
+/*
+ * 向附加报告追加一行，用法同printf
+ */
+static
+void add_report(const char *fmt, ...) {
+    char line[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    PROBLEM::report += line;
+    PROBLEM::report += "\n";
+}
+
+/*
+ * 文件所在的目录，路径中没有'/'时是当前目录
+ */
+static
+std::string parent_dir(const std::string &path) {
+    size_t slash = path.rfind('/');
+    if (slash == std::string::npos) {
+        return ".";
+    }
+    return slash == 0 ? "/" : path.substr(0, slash);
+}
+
+static pid_t metrics_owner = 0;    //负责记录的进程，fork出的子进程继承了回调，不能重复记录
+
+/*
+ * 进程退出时记录退出原因和最终结果，并导出统计
+ */
+static
+void record_metrics(int status, void * /*arg*/) {
+    if (getpid() != metrics_owner) {
+        return;
+    }
+    metrics_add(&metrics->exit_reason[status & 127], 1);
+    if (!PROBLEM::result_file.empty()) {
+        metrics_add(&metrics->verdict[PROBLEM::result & 15], 1);
+    }
+    metrics_export(JUDGE_CONF::METRICS_FILE);
+}
+
+/*
+ * 测出（或从缓存读出）这台机器的速度系数
+ */
+static
+void measure_speed_factor() {
+    double used[CALIBRATE_NUM];
+    const double reference[CALIBRATE_NUM] = {
+        JUDGE_CONF::CALIBRATE_REFERENCE_CPU,
+        JUDGE_CONF::CALIBRATE_REFERENCE_MEMORY,
+        JUDGE_CONF::CALIBRATE_REFERENCE_IO
+    };
+    const double weight[CALIBRATE_NUM] = {
+        JUDGE_CONF::CALIBRATE_WEIGHT_CPU,
+        JUDGE_CONF::CALIBRATE_WEIGHT_MEMORY,
+        JUDGE_CONF::CALIBRATE_WEIGHT_IO
+    };
+    mkdir(parent_dir(JUDGE_CONF::CALIBRATE_FILE).c_str(), 0755);
+    if (!calibrate_host(JUDGE_CONF::CALIBRATE_FILE, JUDGE_CONF::CALIBRATE_TTL, used)) {
+        FM_LOG_WARNING("Cannot calibrate with %s, %d: %s", JUDGE_CONF::CALIBRATE_FILE.c_str(), errno, strerror(errno));
+        exit(JUDGE_CONF::EXIT_BAD_PARAM);
+    }
+    double factor = calibrate_factor(used, reference, weight);
+    PROBLEM::speed_factor = std::min(std::max(factor, JUDGE_CONF::CALIBRATE_MIN_FACTOR),
+                                     JUDGE_CONF::CALIBRATE_MAX_FACTOR);
+    FM_LOG_TRACE("speed factor %.3f (measured %.3f)", PROBLEM::speed_factor, factor);
+}
+
+/*
+ * 测出（或从缓存读出）每次ptrace停顿的开销
+ */
+static
+void measure_stop_cost() {
+    overhead_sample sample;
+    mkdir(parent_dir(JUDGE_CONF::OVERHEAD_FILE).c_str(), 0755);
+    if (!overhead_calibrate(JUDGE_CONF::OVERHEAD_FILE, JUDGE_CONF::OVERHEAD_TTL, sample)) {
+        FM_LOG_WARNING("Cannot calibrate ptrace overhead with %s, %d: %s",
+                JUDGE_CONF::OVERHEAD_FILE.c_str(), errno, strerror(errno));
+        exit(JUDGE_CONF::EXIT_BAD_PARAM);
+    }
+    PROBLEM::stop_cost_ns = std::min(sample.ns_per_stop, JUDGE_CONF::OVERHEAD_MAX_NS);
+}
+
+/*
+ * 读取子任务配置，每行一个子任务：分值 组号 [依赖的子任务编号...]
+ * 组号形如1-3,5，子任务按行从1开始编号，只能依赖前面的子任务
+ */
+static
+void read_subtasks() {
+    FILE *fp = fopen(PROBLEM::subtasks_file.c_str(), "r");
+    if (fp == NULL) {
+        FM_LOG_WARNING("Open subtasks %s failed, %d: %s", PROBLEM::subtasks_file.c_str(), errno, strerror(errno));
+        exit(JUDGE_CONF::EXIT_BAD_PARAM);
+    }
+
+    char line[4096], ranges[4096];
+    while (fgets(line, sizeof(line), fp)) {
+        PROBLEM::subtask t;
+        int off = 0;
+        if (sscanf(line, "%d %4095s%n", &t.score, ranges, &off) != 2) {
+            char first[2];
+            if (sscanf(line, "%1s", first) == 1 && first[0] != '#') {
+                FM_LOG_WARNING("Bad line in subtasks: %s", line);
+                exit(JUDGE_CONF::EXIT_BAD_PARAM);
+            }
+            continue;   //空行或注释
+        }
+
+        const char *p = ranges;
+        int from, to, n;
+        while (sscanf(p, "%d%n", &from, &n) == 1) {
+            p += n;
+            to = from;
+            if (*p == '-' && sscanf(p + 1, "%d%n", &to, &n) == 1) {
+                p += n + 1;
+            }
+            if (from < 1 || to > PROBLEM::case_count || from > to) {
+                FM_LOG_WARNING("Bad cases %d-%d in subtask %d", from, to, (int)PROBLEM::subtasks.size() + 1);
+                exit(JUDGE_CONF::EXIT_BAD_PARAM);
+            }
+            for (int i = from; i <= to; i++) {
+                t.cases.push_back(i - 1);
+            }
+            if (*p == ',') p++;
+        }
+        if (*p != 0 || t.cases.empty() || t.score < 0) {
+            FM_LOG_WARNING("Bad line in subtasks: %s", line);
+            exit(JUDGE_CONF::EXIT_BAD_PARAM);
+        }
+
+        int dep;
+        while (sscanf(line + off, "%d%n", &dep, &n) == 1) {
+            off += n;
+            if (dep < 1 || dep > (int)PROBLEM::subtasks.size()) {
+                FM_LOG_WARNING("Subtask %d cannot depend on %d", (int)PROBLEM::subtasks.size() + 1, dep);
+                exit(JUDGE_CONF::EXIT_BAD_PARAM);
+            }
+            t.depends.push_back(dep - 1);
+        }
+        char rest[2];
+        if (sscanf(line + off, "%1s", rest) == 1) {
+            FM_LOG_WARNING("Bad line in subtasks: %s", line);
+            exit(JUDGE_CONF::EXIT_BAD_PARAM);
+        }
+        PROBLEM::subtasks.push_back(t);
+    }
+    fclose(fp);
+    FM_LOG_TRACE("%d subtasks", (int)PROBLEM::subtasks.size());
+}
+
+/*
+ * 根据代码路径和沙盒路径确定语言以及各个文件的路径
+ */
+static
+void prepare_problem() {
+    if (has_suffix(PROBLEM::code_path, ".cpp")) {
+        PROBLEM::lang = JUDGE_CONF::LANG_CPP;
+    } else if (has_suffix(PROBLEM::code_path, ".c")) {
+        PROBLEM::lang = JUDGE_CONF::LANG_C;
+    } else if (has_suffix(PROBLEM::code_path, ".java")) {
+        PROBLEM::lang = JUDGE_CONF::LANG_JAVA;
+    } else {
+        FM_LOG_WARNING("It seems that you give me a language which I do not known now: %d", PROBLEM::lang);
+        exit(JUDGE_CONF::EXIT_BAD_PARAM);
+    }
+
+    PROBLEM::exec_file = PROBLEM::run_dir + "/a.out";
+    PROBLEM::input_file = PROBLEM::run_dir + "/in.in";
+    PROBLEM::output_file = PROBLEM::run_dir + "/out.out";
+    PROBLEM::exec_output = PROBLEM::run_dir + "/out.txt";
+    PROBLEM::result_file = PROBLEM::run_dir + "/result.txt";
+    PROBLEM::stdout_file_compiler = PROBLEM::run_dir + "/stdout_file_compiler.txt";
+    PROBLEM::stderr_file_compiler = PROBLEM::run_dir + "/stderr_file_compiler.txt";
+    PROBLEM::run_state_file = PROBLEM::run_dir + "/run_state.txt";
+    PROBLEM::report_state_file = PROBLEM::run_dir + "/report_state.txt";
+    PROBLEM::trace_file = PROBLEM::run_dir + "/trace.json";
+    PROBLEM::trace_buffer_file = PROBLEM::run_dir + "/.trace.buf";
+    PROBLEM::progress_file = PROBLEM::run_dir + "/progress";
+    PROBLEM::samples_file = PROBLEM::run_dir + "/samples.txt";
+    PROBLEM::java_runner_status = PROBLEM::run_dir + "/runner_status.txt";
+    PROBLEM::subtasks_file = PROBLEM::run_dir + "/subtasks.txt";
+
+    if (PROBLEM::lang == JUDGE_CONF::LANG_JAVA) {
+        PROBLEM::exec_file = PROBLEM::run_dir + "/Main";
+        //Java放宽内存和时间限制，预热路径省掉了大部分JVM启动开销，放宽得少一些
+        if (PROBLEM::java_cds_archive.empty() && PROBLEM::java_runner_dir.empty()) {
+            PROBLEM::time_limit *= JUDGE_CONF::JAVA_TIME_FACTOR;
+            PROBLEM::memory_limit *= JUDGE_CONF::JAVA_MEM_FACTOR;
+        } else {
+            PROBLEM::time_limit *= JUDGE_CONF::JAVA_WARM_TIME_FACTOR;
+            PROBLEM::memory_limit *= JUDGE_CONF::JAVA_WARM_MEM_FACTOR;
+        }
+    }
+
+    //时限是在参考机器上定的，按这台机器的速度放宽或收紧
+    if (PROBLEM::calibrate) {
+        PROBLEM::time_limit = (int)ceil(PROBLEM::time_limit * PROBLEM::speed_factor);
+        PROBLEM::wall_limit = (int)ceil(PROBLEM::wall_limit * PROBLEM::speed_factor);
+    }
+
+    if (PROBLEM::spj) {
+        switch (PROBLEM::spj_lang) {
+            case 1:
+            case 2: PROBLEM::spj_exec_file = PROBLEM::run_dir + "/SpecialJudge";break;
+            case 3: PROBLEM::spj_exec_file = PROBLEM::run_dir + "/SpecialJudge";break;
+            default:
+                FM_LOG_WARNING("OMG, I really do not kwon the special judge problem language.");
+                exit(JUDGE_CONF::EXIT_BAD_PARAM);
+        }
+
+        PROBLEM::spj_output_file = PROBLEM::run_dir + "/spj_output.txt";
+    }
+
+    PROBLEM::subtasks.clear();
+    if (PROBLEM::case_count > 0 && access(PROBLEM::subtasks_file.c_str(), F_OK) == 0) {
+        read_subtasks();
+    }
+}
+
+/*
+ * 解析参数
+ */
+static
+void parse_arguments(int argc, char* argv[]) {
+    int opt;
+    extern char *optarg;
+
+    while ((opt = getopt(argc, argv, "c:t:m:d:S:sb:w:n:J:R:pC:aM:LHK:W:PTN:r:FE:e:oGU:u:f:Oi:g:x:k:j:ql:")) != -1) {
+        switch (opt) {
+            case 'c': PROBLEM::code_path    = optarg;         break;
+            case 't': PROBLEM::time_limit   = atoi(optarg);   break;
+            case 'm': PROBLEM::memory_limit = atoi(optarg);   break;
+            case 's': PROBLEM::spj          = true;           break;
+            case 'S': PROBLEM::spj_lang     = atoi(optarg);   break;
+            case 'd': PROBLEM::run_dir      = optarg;         break;
+            case 'b': PROBLEM::batch_file   = optarg;         break;
+            case 'n': PROBLEM::case_count   = atoi(optarg);   break;
+            case 'J': PROBLEM::java_cds_archive = optarg;     break;
+            case 'R': PROBLEM::java_runner_dir  = optarg;     break;
+            case 'p': PROBLEM::profile      = true;           break;
+            case 'C': PROBLEM::cpu_list     = optarg;         break;
+            case 'a': PROBLEM::admission    = true;           break;
+            case 'M': PROBLEM::cache_dir    = optarg;         break;
+            case 'L': PROBLEM::landlock     = true;           break;
+            case 'H': PROBLEM::residency    = true;           break;
+            case 'P': PROBLEM::metrics      = true;           break;
+            case 'T': PROBLEM::trace        = true;           break;
+            case 'G': PROBLEM::progress     = true;           break;
+            case 'i': PROBLEM::sample_interval = atoi(optarg); break;
+            case 'U': PROBLEM::ns_pool_dir  = optarg;         break;
+            case 'u': PROBLEM::ns_pool_size = atoi(optarg);   break;
+            case 'f': PROBLEM::tracer_priority = atoi(optarg); break;
+            case 'N': PROBLEM::threads      = atoi(optarg);   break;
+            case 'r': PROBLEM::wall_limit   = atoi(optarg);   break;
+            case 'F': PROBLEM::calibrate    = true;           break;
+            case 'O': PROBLEM::overhead     = true;           break;
+            case 'q': PROBLEM::seccomp      = true;           break;
+            case 'l': break;    //日志已经在judge_main中打开
+            case 'E': PROBLEM::fail_stats_dir = optarg;       break;
+            case 'e': PROBLEM::sample_count = atoi(optarg);   break;
+            case 'o': PROBLEM::first_failure = true;          break;
+            case 'K': PROBLEM::residency_budget = atoi(optarg); break;
+            case 'W': PROBLEM::warm_dirs.push_back(optarg);   break;
+            case 'g': PROBLEM::stress_generator = optarg;     break;
+            case 'x': PROBLEM::stress_reference = optarg;     break;
+            case 'k': PROBLEM::stress_count = atoi(optarg);   break;
+            case 'j': PROBLEM::stress_workers = atoi(optarg); break;
+            case 'w':
+                if (3 != sscanf(optarg, "%d:%d:%d", &JUDGE_CONF::BATCH_COMPILE_WORKERS,
+                            &JUDGE_CONF::BATCH_RUN_WORKERS, &JUDGE_CONF::BATCH_COMPARE_WORKERS) ||
+                    JUDGE_CONF::BATCH_COMPILE_WORKERS < 1 || JUDGE_CONF::BATCH_RUN_WORKERS < 1 ||
+                    JUDGE_CONF::BATCH_COMPARE_WORKERS < 1) {
+                    FM_LOG_WARNING("Bad worker counts: -w %s", optarg);
+                    exit(JUDGE_CONF::EXIT_BAD_PARAM);
+                }
+                break;
+            default:
+                FM_LOG_WARNING("Unknown option provided: -%c %s", opt, optarg);
+                exit(JUDGE_CONF::EXIT_BAD_PARAM);
+        }
+    }
+
+    if (!PROBLEM::stress_generator.empty() &&
+        (PROBLEM::stress_reference.empty() || PROBLEM::spj || PROBLEM::stress_count < 1)) {
+        FM_LOG_WARNING("Stress mode needs -g, -x and a positive -k, and cannot use special judge.");
+        exit(JUDGE_CONF::EXIT_BAD_PARAM);
+    }
+
+    if (!PROBLEM::cpu_list.empty() &&
+        !cpu_alloc_init(PROBLEM::cpu_list.c_str(), JUDGE_CONF::CPU_LOCK_DIR.c_str())) {
+        FM_LOG_WARNING("Bad cpu list: -C %s", PROBLEM::cpu_list.c_str());
+        exit(JUDGE_CONF::EXIT_BAD_PARAM);
+    }
+
+    if (!PROBLEM::cpu_list.empty() && PROBLEM::threads > cpu_slot_count()) {
+        FM_LOG_WARNING("-N %d needs more cores than -C %s has", PROBLEM::threads, PROBLEM::cpu_list.c_str());
+        exit(JUDGE_CONF::EXIT_BAD_PARAM);
+    }
+
+    if (PROBLEM::landlock && landlock_abi() < 1) {
+        FM_LOG_WARNING("Landlock unavailable, fall back to checking open() by ptrace");
+        PROBLEM::landlock = false;
+    }
+
+    //多线程模式要检查每个clone的参数、统计线程数，仍然用ptrace
+    if (PROBLEM::seccomp && (PROBLEM::threads > 0 || !seccomp_notify_available())) {
+        FM_LOG_WARNING("seccomp supervision unavailable%s, fall back to ptrace",
+                PROBLEM::threads > 0 ? " with threads" : "");
+        PROBLEM::seccomp = false;
+    }
+
+    //seccomp监控时用户程序不在系统调用处停下，没有停顿开销可扣
+    if (PROBLEM::seccomp && PROBLEM::overhead) {
+        FM_LOG_WARNING("No ptrace stops under seccomp supervision, -O ignored");
+        PROBLEM::overhead = false;
+    }
+
+    if (!PROBLEM::cache_dir.empty() && !verdict_cache_init(PROBLEM::cache_dir)) {
+        FM_LOG_WARNING("Cannot use verdict cache dir %s, %d: %s", PROBLEM::cache_dir.c_str(), errno, strerror(errno));
+        exit(JUDGE_CONF::EXIT_BAD_PARAM);
+    }
+
+    if (!PROBLEM::fail_stats_dir.empty() && !fail_stats_init(PROBLEM::fail_stats_dir)) {
+        FM_LOG_WARNING("Cannot use fail stats dir %s, %d: %s", PROBLEM::fail_stats_dir.c_str(), errno, strerror(errno));
+        exit(JUDGE_CONF::EXIT_BAD_PARAM);
+    }
+
+    if (PROBLEM::metrics) {
+        mkdir(parent_dir(JUDGE_CONF::METRICS_SHM).c_str(), 0755);
+        if (!metrics_init(JUDGE_CONF::METRICS_SHM)) {
+            FM_LOG_WARNING("Cannot map metrics %s, %d: %s", JUDGE_CONF::METRICS_SHM.c_str(), errno, strerror(errno));
+            exit(JUDGE_CONF::EXIT_BAD_PARAM);
+        }
+        metrics_owner = getpid();
+        on_exit(record_metrics, NULL);
+    }
+
+    if ((PROBLEM::residency || PROBLEM::residency_budget > 0) &&
+        !residency_init(JUDGE_CONF::RESIDENCY_DIR)) {
+        FM_LOG_WARNING("Cannot use residency dir %s, %d: %s", JUDGE_CONF::RESIDENCY_DIR.c_str(), errno, strerror(errno));
+        exit(JUDGE_CONF::EXIT_BAD_PARAM);
+    }
+
+    //加入命名空间要在fork任何子进程之前
+    bool manager = PROBLEM::residency_budget > 0 || PROBLEM::ns_pool_size > 0;  //常驻管理进程不评测
+    if (!PROBLEM::ns_pool_dir.empty() && !manager) {
+        if (!ns_pool_enter(PROBLEM::ns_pool_dir, JUDGE_CONF::NS_POOL_WAIT)) {
+            exit(JUDGE_CONF::EXIT_NS_POOL);
+        }
+        atexit(ns_pool_reset);
+    }
+
+    if (PROBLEM::calibrate && !manager) {
+        measure_speed_factor();
+    }
+
+    if (PROBLEM::overhead && !manager) {
+        measure_stop_cost();
+    }
+
+    //批量评测时每个提交的参数来自清单
+    if (PROBLEM::batch_file.empty() && !manager) {
+        prepare_problem();
+    }
+}
+
+static
+void get_compile_error_message() {
+    FILE *ce_msg = fopen(PROBLEM::stderr_file_compiler.c_str(), "r");
+    std::string message = "";
+    char tmp[1024];
+    size_t limit = JUDGE_CONF::COMPILE_MESSAGE_LIMIT * JUDGE_CONF::KILO;
+    while (ce_msg != NULL && fgets(tmp, sizeof(tmp), ce_msg)) {
+        if (message.size() + strlen(tmp) > limit) {
+            message += "...(truncated)\n";    //模板展开出错时信息可能有几百MB
+            break;
+        }
+        message += tmp;
+    }
+    if (ce_msg != NULL) {
+        fclose(ce_msg);
+    }
+
+    PROBLEM::extra_message += message;
+}
+
+static
+void timeout(int signo) {
+    //超时的回调函数
+    if (signo == SIGALRM) {
+        exit(JUDGE_CONF::EXIT_TIMEOUT);
+    }
+}
+
+static
+int malarm(int which, int milliseconds) {
+    struct itimerval t;
+    //设置时间限制
+    t.it_value.tv_sec     = milliseconds / 1000;
+    t.it_value.tv_usec    = milliseconds % 1000 * 1000; //微秒
+    t.it_interval.tv_sec  = 0;
+    t.it_interval.tv_usec = 0;
+    return setitimer(which, &t, NULL);
+}
+
+/*
+ * 准入控制，压力降不下来就以EXIT_PRESSURE退出，由调度方重新排队
+ * 观察到的压力记录在附加报告里，便于事后核查
+ */
+static
+void admit(const char *phase, const pressure_policy &policy) {
+    if (!PROBLEM::admission) {
+        return;
+    }
+    double value[PRESSURE_NUM];
+    int waited_ms = 0;
+    bool ok = pressure_admit(policy, value, waited_ms);
+    add_report("[pressure %s]", phase);
+    for (int i = 0; i < PRESSURE_NUM; i++) {
+        add_report("%s %.2f", PRESSURE_NAME[i], value[i]);
+    }
+    add_report("waited %d", waited_ms);
+    if (!ok) {
+        PROBLEM::extra_message = "System under pressure, please requeue";
+        exit(JUDGE_CONF::EXIT_PRESSURE);
+    }
+}
+
+/*
+ * 输入输出重定向
+ */
+static
+void io_redirect() {
+    FM_LOG_TRACE("Start to redirect the IO.");
+    if (PROBLEM::input_fd >= 0) {
+        //压缩的输入，从解压管道读
+        if (dup2(PROBLEM::input_fd, STDIN_FILENO) < 0) {
+            stdin = NULL;
+        }
+    } else {
+        stdin = freopen(PROBLEM::input_file.c_str(), "r", stdin);
+    }
+    stdout = freopen(PROBLEM::exec_output.c_str(), "w", stdout);
+    //stderr = freopen("/dev/null", "w", stderr);
+
+    if (stdin == NULL || stdout == NULL) {
+        FM_LOG_WARNING("It occur a error when freopen: stdin(%p) stdout(%p)", stdin, stdout);
+        exit(JUDGE_CONF::EXIT_PRE_JUDGE);
+    }
+    FM_LOG_TRACE("redirect io is OK.");
+}
+
+/*
+ * 安全性控制
+ * chroot限制程序只能在某目录下操作，无法影响到外界
+ * setuid使其只拥有nobody的最低系统权限
+ */
+static
+void security_control() {
+    struct passwd *nobody = getpwnam("nobody");
+    if (nobody == NULL){
+        FM_LOG_WARNING("Well, where is nobody? I cannot live without him. %d: %s", errno, strerror(errno));
+        exit(JUDGE_CONF::EXIT_SET_SECURITY);
+    }
+
+    //不是root时沙盒目录属于用户程序映射成的用户，要先挂成只读，输出文件已经打开
+    if (ns_pool_active() && PROBLEM::lang != JUDGE_CONF::LANG_JAVA &&
+        !ns_pool_seal(PROBLEM::run_dir)) {
+        exit(JUDGE_CONF::EXIT_SET_SECURITY);
+    }
+
+    //chdir
+    if (EXIT_SUCCESS != chdir(PROBLEM::run_dir.c_str())) {
+        FM_LOG_WARNING("chdir(%s) failed, %d: %s", PROBLEM::run_dir.c_str(), errno, strerror(errno));
+        exit(JUDGE_CONF::EXIT_SET_SECURITY);
+    }
+
+    char cwd[1024], *tmp = getcwd(cwd, 1024);
+    if (tmp == NULL) {
+        FM_LOG_WARNING("Oh, where i am now? I cannot getcwd. %d: %s", errno, strerror(errno));
+        exit(JUDGE_CONF::EXIT_SET_SECURITY);
+    }
+
+    //chroot
+    //Java比较特殊，一旦chroot或setuid，那么JVM就跑不起来了
+    if (PROBLEM::lang != JUDGE_CONF::LANG_JAVA) {
+        if (EXIT_SUCCESS != chroot(cwd)) {
+            FM_LOG_WARNING("chroot(%s) failed. %d: %s", cwd, errno, strerror(errno));
+            exit(JUDGE_CONF::EXIT_SET_SECURITY);
+        }
+        //setuid
+        if (EXIT_SUCCESS != setuid(nobody->pw_uid)) {
+            FM_LOG_WARNING("setuid(%d) failed. %d: %s", nobody->pw_uid, errno, strerror(errno));
+            exit(JUDGE_CONF::EXIT_SET_SECURITY);
+        }
+    }
+
+}
+
+/*
+ * Landlock的文件访问规则，在security_control之前调用，相对的-d等路径在chdir之前解析
+ * C/C++之后会chroot到沙盒，只读整个根目录，只能写输出文件，路径是chroot之后的；
+ * Java没有chroot，只读沙盒和JAVA_READ_PATHS
+ */
+static
+std::vector<fs_rule> security_fs_rules() {
+    std::vector<fs_rule> rules;
+    std::string output = PROBLEM::exec_output.substr(PROBLEM::run_dir.size());
+    if (PROBLEM::lang != JUDGE_CONF::LANG_JAVA) {
+        fs_rule root = {"/", FS_READ, true};
+        fs_rule out = {output, FS_WRITE, true};
+        rules.push_back(root);
+        rules.push_back(out);
+        return rules;
+    }
+
+    //JudgeRunner要在沙盒里创建各组的输出和状态文件
+    bool ok = fs_rule_add(rules, PROBLEM::run_dir, FS_READ | (PROBLEM::java_runner_dir.empty() ? 0 : FS_WRITE), true) &&
+              fs_rule_add(rules, PROBLEM::exec_output, FS_WRITE, true);
+    if (!PROBLEM::java_runner_dir.empty()) {
+        ok = ok && fs_rule_add(rules, PROBLEM::java_runner_dir, FS_READ, true);
+    }
+    if (!PROBLEM::java_cds_archive.empty()) {
+        ok = ok && fs_rule_add(rules, PROBLEM::java_cds_archive, FS_READ, false);   //归档可能还没生成
+    }
+    const std::string &paths = JUDGE_CONF::JAVA_READ_PATHS;
+    size_t start = 0, end;
+    while (ok && start <= paths.size()) {
+        end = paths.find(':', start);
+        if (end == std::string::npos) end = paths.size();
+        if (end > start) {
+            ok = fs_rule_add(rules, paths.substr(start, end - start), FS_READ, false);
+        }
+        start = end + 1;
+    }
+    if (!ok) {
+        exit(JUDGE_CONF::EXIT_SET_SECURITY);
+    }
+    return rules;
+}
+
+/*
+ * 对SpecialJudge程序的安全性控制
+ * 毕竟不是自己写的代码，得防着点
+ */
+static
+void security_control_spj() {
+    struct passwd *nobody = getpwnam("nobody");
+    if (nobody == NULL) {
+        FM_LOG_WARNING("Well, where is nobody? I cannot live without him. %d: %s", errno, strerror(errno));
+        exit(JUDGE_CONF::EXIT_SET_SECURITY);
+    }
+
+    if (EXIT_SUCCESS != chdir(PROBLEM::run_dir.c_str())) {
+        FM_LOG_WARNING("chdir(%s) failed, %d: %s", PROBLEM::run_dir.c_str(), errno, strerror(errno));
+        exit(JUDGE_CONF::EXIT_SET_SECURITY);
+    }
+
+    char cwd[1024], *tmp = getcwd(cwd, 1024);
+    if (tmp == NULL) {
+        FM_LOG_WARNING("Oh, where i am now? I cannot getcwd. %d: %s", errno, strerror(errno));
+        exit(JUDGE_CONF::EXIT_SET_SECURITY);
+    }
+
+    //if (PROBLEM::spj_lang != JUDGE_CONF::LANG_JAVA) {
+    //    if (EXIT_SUCCESS != chroot(cwd)) {
+    //        FM_LOG_WARNING("chroot(%s) failed. %d: %s", cwd, errno, strerror(errno));
+    //        exit(JUDGE_CONF::EXIT_SET_SECURITY);
+    //    }
+    //}
+
+    //if (EXIT_SUCCESS != setuid(nobody->pw_uid)) {
+    //    FM_LOG_WARNING("setuid(%d) failed. %d: %s", nobody->pw_uid, errno, strerror(errno));
+    //    exit(JUDGE_CONF::EXIT_SET_SECURITY);
+    //}
+}
+
+/*
+ * 运行时实际施加的CPU时间限制
+ * 扣除停顿开销时留出余量，先让程序跑完，扣除之后再按时间限制判断
+ */
+static
+int run_time_limit() {
+    if (!PROBLEM::overhead) {
+        return PROBLEM::time_limit;
+    }
+    return PROBLEM::time_limit + PROBLEM::time_limit * JUDGE_CONF::OVERHEAD_HEADROOM / 100;
+}
+
+/*
+ * 程序运行的限制
+ * CPU时间、堆栈、输出文件大小等
+ */
+static
+void set_limit() {
+    rlimit lim;
+
+    lim.rlim_max = (run_time_limit() - PROBLEM::time_usage + 999) / 1000 + 1;//硬限制
+    lim.rlim_cur = lim.rlim_max; //软限制
+    if (setrlimit(RLIMIT_CPU, &lim) < 0) {
+        FM_LOG_WARNING("error setrlimit for RLIMIT_CPU");
+        exit(JUDGE_CONF::EXIT_SET_LIMIT);
+    }
+
+    //内存不能在此做限制
+    //原因忘了，反正是linux的内存分配机制的问题
+    //所以得在运行时不断累计内存使用量来限制
+
+
+    //堆栈空间限制
+    getrlimit(RLIMIT_STACK, &lim);
+
+    int rlim = JUDGE_CONF::STACK_SIZE_LIMIT * JUDGE_CONF::KILO;
+    if (lim.rlim_max <= rlim) {
+        FM_LOG_WARNING("cannot set stack size to higher(%d <= %d)", lim.rlim_max, rlim);
+    } else {
+        lim.rlim_max = rlim;
+        lim.rlim_cur = rlim;
+
+        if (setrlimit(RLIMIT_STACK, &lim) < 0) {
+            FM_LOG_WARNING("error setrlimit for RLIMIT_STACK");
+            exit(JUDGE_CONF::EXIT_SET_LIMIT);
+        }
+    }
+
+    log_close(); //关闭log，防止log造成OLE
+
+    //输出文件大小限制
+    lim.rlim_max = PROBLEM::output_limit * JUDGE_CONF::KILO;
+    lim.rlim_cur = lim.rlim_max;
+    if (setrlimit(RLIMIT_FSIZE, &lim) < 0) {
+        perror("setrlimit RLIMIT_FSIZE failed\n");
+        exit(JUDGE_CONF::EXIT_SET_LIMIT);
+    }
+}
+
+/*
+ * 这个函数不是我写的
+ */
+#include "rf_table.h"
+//次数用完的open/openat只允许打开这些路径
+static
+bool is_valid_path(const char *filename) {
+    if (strstr(filename, "..") != NULL)
+    {
+        return false;
+    }
+    if (strstr(filename, "/proc/") == filename)
+    {
+        return true;
+    }
+    //OpenMP等运行库读取CPU拓扑，只读，chroot后也不存在
+    if (strstr(filename, "/sys/devices/system/cpu/") == filename)
+    {
+        return true;
+    }
+    if (strstr(filename, "/dev/tty") == filename)
+    {
+        PROBLEM::result = JUDGE_CONF::RE;
+        exit(JUDGE_CONF::EXIT_OK);
+    }
+    return false;
+}
+
+//系统调用在进和出的时候都会暂停, 把控制权交给judge
+//in_syscall是每个线程各自的状态
+static
+bool is_valid_syscall(int lang, int syscall_id, pid_t child, user_regs_struct regs, bool &in_syscall) {
+    in_syscall = !in_syscall;
+    //FM_LOG_DEBUG("syscall: %d, %s, count: %d", syscall_id, in_syscall?"in":"out", RF_table[syscall_id]);
+    if (RF_table[syscall_id] == 0)
+    {
+        //如果RF_table中对应的syscall_id可以被调用的次数为0, 则为RF
+        long addr;
+        if(syscall_id == SYS_open || syscall_id == SYS_openat)
+        {
+            //openat的路径是第二个参数，新的glibc和多线程运行库都用openat
+#if __WORDSIZE == 32
+            addr = syscall_id == SYS_open ? regs.ebx : regs.ecx;
+#else
+            addr = syscall_id == SYS_open ? regs.rdi : regs.rsi;
+#endif
+#define LONGSIZE sizeof(long)
+            union u{ unsigned long val; char chars[LONGSIZE]; }data;
+            unsigned long i = 0, j = 0, k = 0;
+            char filename[300];
+            while (true)
+            {
+                data.val = ptrace(PTRACE_PEEKDATA, child, addr + i,  NULL);
+                i += LONGSIZE;
+                for (j = 0; j < LONGSIZE && data.chars[j] > 0 && k < 256; j++)
+                {
+                    filename[k++] = data.chars[j];
+                }
+                if (j < LONGSIZE && data.chars[j] == 0)
+                    break;
+            }
+            filename[k] = 0;
+            //FM_LOG_TRACE("syscall open: filename: %s", filename);
+            return is_valid_path(filename);
+        }
+        return false;
+    } else if (RF_table[syscall_id] > 0) {
+        //如果RF_table中对应的syscall_id可被调用的次数>0
+        //且是在退出syscall的时候, 那么次数减一
+        if (in_syscall == false)
+            RF_table[syscall_id]--;
+    } else {
+        //RF_table中syscall_id对应的指<0, 表示是不限制调用的
+        ;
+    }
+    return true;
+}
+
+/*
+ * 在编译进程exec之前限制它和它的子进程（cc1、as、ld等）的资源
+ * rlimit对每个进程分别生效，有cgroup时再限制所有编译进程的内存之和与进程数
+ */
+static
+void limit_compiler(const std::string &cgroup) {
+    if (!cgroup.empty() && !cgroup_enter(cgroup)) {
+        FM_LOG_WARNING("enter cgroup %s failed, %d: %s", cgroup.c_str(), errno, strerror(errno));
+        exit(JUDGE_CONF::EXIT_COMPILE);
+    }
+
+    struct rlimit lim;
+    lim.rlim_cur = lim.rlim_max = JUDGE_CONF::COMPILE_CPU_LIMIT;
+    lim.rlim_max += 1;  //软限制时SIGXCPU，多给一秒再SIGKILL
+    bool ok = setrlimit(RLIMIT_CPU, &lim) == 0;
+    lim.rlim_cur = lim.rlim_max = (rlim_t)JUDGE_CONF::COMPILE_FILE_LIMIT * JUDGE_CONF::MEGA;
+    ok = ok && setrlimit(RLIMIT_FSIZE, &lim) == 0;
+    //JVM启动时就要预留很大的地址空间，javac的内存由-J-Xmx限制
+    if (PROBLEM::lang != JUDGE_CONF::LANG_JAVA) {
+        lim.rlim_cur = lim.rlim_max = (rlim_t)JUDGE_CONF::COMPILE_MEMORY_LIMIT * JUDGE_CONF::MEGA;
+        ok = ok && setrlimit(RLIMIT_AS, &lim) == 0;
+    }
+    if (!ok) {
+        FM_LOG_WARNING("setrlimit for compiler failed, %d: %s", errno, strerror(errno));
+        exit(JUDGE_CONF::EXIT_COMPILE);
+    }
+}
+
+/*
+ * 编译错误信息的最后一段里是否有某个字符串
+ * gcc的子进程（cc1、as、ld）被信号杀掉时，gcc在最后输出"<信号名> signal terminated program <程序>"
+ */
+static
+bool compile_message_ends_with(const char *text) {
+    FILE *fp = fopen(PROBLEM::stderr_file_compiler.c_str(), "r");
+    if (fp == NULL) {
+        return false;
+    }
+    char tail[4096];
+    if (fseek(fp, -(long)(sizeof(tail) - 1), SEEK_END) < 0) {
+        rewind(fp);
+    }
+    size_t len = fread(tail, 1, sizeof(tail) - 1, fp);
+    tail[len] = 0;
+    fclose(fp);
+    return strstr(tail, text) != NULL;
+}
+
+static
+bool compile_child_signaled(int sig) {
+    std::string text = std::string(strsignal(sig)) + " signal terminated program";
+    return compile_message_ends_with(text.c_str());
+}
+
+/*
+ * 编译失败时判断是不是超出了资源限制，是则返回给用户看的说明，否则返回NULL
+ */
+static
+const char *compile_limit_breached(int status, const struct rusage &rused, const std::string &cgroup) {
+    if (!cgroup.empty() && cgroup_event(cgroup, "memory.events", "oom_kill") > 0) {
+        return "Compile Memory Limit Exceeded";
+    }
+    if (!cgroup.empty() && cgroup_event(cgroup, "pids.events", "max") > 0) {
+        return "Compile Process Limit Exceeded";
+    }
+    long long cpu = rused.ru_utime.tv_sec * 1000LL + rused.ru_utime.tv_usec / 1000 +
+                    rused.ru_stime.tv_sec * 1000LL + rused.ru_stime.tv_usec / 1000;
+    if ((WIFSIGNALED(status) && WTERMSIG(status) == SIGXCPU) ||
+        cpu >= JUDGE_CONF::COMPILE_CPU_LIMIT * 1000LL ||
+        compile_child_signaled(SIGXCPU) || compile_child_signaled(SIGKILL)) {   //SIGKILL来自RLIMIT_CPU的硬限制
+        return "Compile CPU Limit Exceeded";
+    }
+    long long file_limit = (long long)JUDGE_CONF::COMPILE_FILE_LIMIT * JUDGE_CONF::MEGA;
+    struct stat st;
+    if ((WIFSIGNALED(status) && WTERMSIG(status) == SIGXFSZ) ||
+        (stat(PROBLEM::stderr_file_compiler.c_str(), &st) == 0 && st.st_size >= file_limit) ||
+        (stat(PROBLEM::exec_file.c_str(), &st) == 0 && st.st_size >= file_limit) ||
+        compile_child_signaled(SIGXFSZ)) {
+        return "Compile Output Limit Exceeded";
+    }
+    if (compile_message_ends_with("out of memory") || compile_message_ends_with("memory exhausted")) {
+        return "Compile Memory Limit Exceeded";
+    }
+    return NULL;
+}
+
+/*
+ * 编译源代码
+ */
+static
+void compiler_source_code() {
+    pressure_policy policy = {
+        {JUDGE_CONF::COMPILE_PRESSURE_CPU, JUDGE_CONF::COMPILE_PRESSURE_MEMORY, JUDGE_CONF::COMPILE_PRESSURE_IO},
+        JUDGE_CONF::COMPILE_PRESSURE_WAIT
+    };
+    admit("compile", policy);
+
+    long long start_us = metrics_now_us();
+    trace_begin("compile");
+    progress_phase(PROGRESS_COMPILE);
+
+    char name[32];
+    snprintf(name, sizeof(name), "compile-%d", (int)getpid());
+    std::string cgroup = cgroup_create(JUDGE_CONF::COMPILE_CGROUP, name);
+    if (!cgroup.empty()) {
+        long long memory = (long long)JUDGE_CONF::COMPILE_MEMORY_LIMIT * JUDGE_CONF::MEGA;
+        if (!cgroup_set(cgroup, "memory.max", memory) ||
+            !cgroup_set(cgroup, "pids.max", JUDGE_CONF::COMPILE_PROCESS_LIMIT)) {
+            cgroup_destroy(cgroup);
+            cgroup = "";
+        } else {
+            cgroup_write(cgroup, "memory.swap.max", "0");   //不许把机器拖进swap，没有swap控制器时忽略
+        }
+    }
+
+    trace_begin("fork");
+    pid_t compiler = fork();
+    int status = 0;
+    struct rusage rused;
+    if (compiler < 0) {
+        FM_LOG_WARNING("error fork compiler");
+        exit(JUDGE_CONF::EXIT_COMPILE);
+    } else if (compiler == 0) {
+        //子进程，编译程序
+        log_add_info("compiler");
+        stdout = freopen(PROBLEM::stdout_file_compiler.c_str(), "w", stdout);
+        stderr = freopen(PROBLEM::stderr_file_compiler.c_str(), "w", stderr);
+        if (stdout == NULL || stderr == NULL) {
+            FM_LOG_WARNING("error to freopen in compiler: stdout(%p) stderr(%p)", stdout, stderr);
+            exit(JUDGE_CONF::EXIT_COMPILE);
+        }
+
+        malarm(ITIMER_REAL, JUDGE_CONF::COMPILE_TIME_LIMIT);//设置编译时间限制
+        limit_compiler(cgroup);
+        trace_instant("exec");
+        //多线程模式支持OpenMP和std::thread，为NULL时参数到此结束
+        const char *thread_flag = PROBLEM::threads > 0 ? "-fopenmp" : NULL;
+        switch (PROBLEM::lang) {
+            case JUDGE_CONF::LANG_C:
+                FM_LOG_TRACE("Start: gcc -o %s %s -static -w -lm -std=c99 -O2 -DONLINE_JUDGE",
+                        PROBLEM::exec_file.c_str(), PROBLEM::code_path.c_str());
+                execlp("gcc", "gcc", "-o", PROBLEM::exec_file.c_str(), PROBLEM::code_path.c_str(),
+                        "-static", "-w", "-lm", "-std=c99", "-O2", "-DONLINE_JUDGE", thread_flag, NULL);
+                break;
+            case JUDGE_CONF::LANG_CPP:
+                FM_LOG_TRACE("Start: g++ -o %s %s -static -w -lm -O2 -DONLINE_JUDGE",
+                        PROBLEM::exec_file.c_str(), PROBLEM::code_path.c_str());
+                execlp("g++", "g++", "-o", PROBLEM::exec_file.c_str(), PROBLEM::code_path.c_str(),
+                        "-static", "-w", "-lm", "-O2", "-std=c++11", "-DONLINE_JUDGE", thread_flag, NULL);
+                break;
+            case JUDGE_CONF::LANG_JAVA:
+                FM_LOG_TRACE("Start:javac %s -d %s", PROBLEM::code_path.c_str(), PROBLEM::run_dir.c_str());
+                {
+                    char heap[32];
+                    snprintf(heap, sizeof(heap), "-J-Xmx%dm", JUDGE_CONF::COMPILE_MEMORY_LIMIT / 2);
+                    execlp("javac", "javac", heap, PROBLEM::code_path.c_str(), "-d", PROBLEM::run_dir.c_str(), NULL);
+                }
+            //在这里增加新的语言支持
+        }
+        FM_LOG_WARNING("exec compiler error");
+        exit(JUDGE_CONF::EXIT_COMPILE);
+    } else {
+        //父进程
+        trace_end("fork");
+        pid_t w = wait4(compiler, &status, WUNTRACED, &rused); //阻塞等待子进程结束
+        if (w == -1) {
+            FM_LOG_WARNING("waitpid error");
+            cgroup_destroy(cgroup);
+            exit(JUDGE_CONF::EXIT_COMPILE);
+        }
+        metrics_observe(METRIC_COMPILE, start_us);
+        trace_end("compile");
+
+        FM_LOG_TRACE("compiler finished");
+        //超出资源限制时编译器的退出方式各不相同（被信号杀掉、内部错误、普通的编译错误），统一按CE处理
+        const char *breach = NULL;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+            if (!(WIFSIGNALED(status) && WTERMSIG(status) == SIGALRM)) {
+                breach = compile_limit_breached(status, rused, cgroup);
+            }
+        }
+        cgroup_destroy(cgroup);
+        if (breach != NULL) {
+            FM_LOG_WARNING("%s", breach);
+            PROBLEM::result = JUDGE_CONF::CE;
+            PROBLEM::extra_message += std::string(breach) + "\n";
+            get_compile_error_message();
+            exit(JUDGE_CONF::EXIT_OK);
+        }
+        if (WIFEXITED(status)) {
+            //编译程序自行退出
+            if (EXIT_SUCCESS == WEXITSTATUS(status)) {
+                FM_LOG_TRACE("compile succeeded.");
+            } else if (JUDGE_CONF::GCC_COMPILE_ERROR == WEXITSTATUS(status)){
+                //编译错误
+                FM_LOG_TRACE("compile error");
+                PROBLEM::result = JUDGE_CONF::CE;
+                get_compile_error_message();
+                exit(JUDGE_CONF::EXIT_OK);
+            } else {
+                FM_LOG_WARNING("Unknown error occur when compiling the source code.Exit status %d", WEXITSTATUS(status));
+                exit(JUDGE_CONF::EXIT_COMPILE);
+            }
+        } else {
+            //编译程序被终止
+            if (WIFSIGNALED(status)){
+                if (SIGALRM == WTERMSIG(status)) {
+                    FM_LOG_WARNING("Compile time out");
+                    PROBLEM::result = JUDGE_CONF::CE;
+                    PROBLEM::extra_message = "Compile Out of Time Limit";
+                    exit(JUDGE_CONF::EXIT_OK);
+                } else {
+                    FM_LOG_WARNING("Unknown signal when compile the source code.");
+                }
+            } else if (WIFSTOPPED(status)){
+                FM_LOG_WARNING("The compile process stopped by signal");
+            } else {
+                FM_LOG_WARNING("I don't kwon why the compile process stopped");
+            }
+            exit(JUDGE_CONF::EXIT_COMPILE);
+        }
+    }
+}
+
+/*
+ * 生成Java的类数据共享归档
+ * 归档包含java/classlist中列出的常用JDK类以及JudgeRunner，
+ * 只在归档不存在时生成一次，之后所有提交共享
+ */
+static
+void prepare_java_cds_archive() {
+    if (PROBLEM::java_cds_archive.empty() ||
+        access(PROBLEM::java_cds_archive.c_str(), R_OK) == 0) {
+        return;
+    }
+
+    std::string class_list = PROBLEM::java_cds_archive + ".classlist";
+    if (access(class_list.c_str(), R_OK) != 0) {
+        FM_LOG_WARNING("No class list %s, the JVM will start without the CDS archive", class_list.c_str());
+        return;
+    }
+
+    FM_LOG_NOTICE("Dump java CDS archive to %s", PROBLEM::java_cds_archive.c_str());
+    pid_t dumper = fork();
+    if (dumper < 0) {
+        FM_LOG_WARNING("fork for CDS dump failed.");
+        return;
+    } else if (dumper == 0) {
+        std::string list_arg = "-XX:SharedClassListFile=" + class_list;
+        std::string archive_arg = "-XX:SharedArchiveFile=" + PROBLEM::java_cds_archive;
+        std::string cp = PROBLEM::java_runner_dir.empty() ? "." : PROBLEM::java_runner_dir;
+        stdout = freopen("/dev/null", "w", stdout);
+        execlp("java", "java", "-Xshare:dump", list_arg.c_str(), archive_arg.c_str(),
+                "-cp", cp.c_str(), NULL);
+        _exit(JUDGE_CONF::EXIT_PRE_JUDGE_EXECLP);
+    }
+    int status = 0;
+    if (waitpid(dumper, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        FM_LOG_WARNING("java -Xshare:dump failed, the JVM will start without the CDS archive");
+        unlink(PROBLEM::java_cds_archive.c_str());
+    }
+}
+
+/*
+ * 启动JVM，在judge的子进程中调用
+ * 使用JudgeRunner时，一个JVM依次跑完这一批测试数据
+ */
+static
+void exec_java() {
+    std::vector<std::string> args;
+    args.push_back("java");
+    if (!PROBLEM::java_cds_archive.empty() &&
+        access(PROBLEM::java_cds_archive.c_str(), R_OK) == 0) {
+        args.push_back("-Xshare:auto");
+        args.push_back("-XX:SharedArchiveFile=" + PROBLEM::java_cds_archive);
+    }
+    if (PROBLEM::java_runner_cases.empty()) {
+        args.push_back("Main");
+    } else {
+        args.push_back("-cp");
+        args.push_back(PROBLEM::java_runner_dir);
+        args.push_back("JudgeRunner");
+        args.push_back("runner_status.txt");
+        char name[64];
+        //JVM整体的时间限制已按组数放大，看门狗用单组的
+        snprintf(name, sizeof(name), "%d", PROBLEM::time_limit / (int)PROBLEM::java_runner_cases.size());
+        args.push_back(name);
+        for (size_t k = 0; k < PROBLEM::java_runner_cases.size(); k++) {
+            int i = PROBLEM::java_runner_cases[k] + 1;
+            snprintf(name, sizeof(name), "%d", i);
+            args.push_back(name);
+            snprintf(name, sizeof(name), "in%d.in", i);
+            args.push_back(name);
+            snprintf(name, sizeof(name), "out%d.txt", i);
+            args.push_back(name);
+        }
+    }
+
+    std::vector<char *> argv;
+    for (size_t i = 0; i < args.size(); i++) {
+        argv.push_back(const_cast<char *>(args[i].c_str()));
+    }
+    argv.push_back(NULL);
+    execvp("java", &argv[0]);
+}
+
+/*
+ * 多线程模式下的墙钟时间限制
+ */
+static
+int wall_time_limit() {
+    return PROBLEM::wall_limit > 0 ? PROBLEM::wall_limit : PROBLEM::time_limit;
+}
+
+/*
+ * clone是否只是创建线程，clone3的参数是结构体，第一个成员是flags
+ */
+static
+bool clone_creates_thread(pid_t tid, int syscall_id, const user_regs_struct &regs) {
+#ifdef __i386__
+    long arg = regs.ebx;
+#else
+    long arg = regs.rdi;
+#endif
+    unsigned long flags = arg;
+#ifdef SYS_clone3
+    if (syscall_id == SYS_clone3) {
+        flags = ptrace(PTRACE_PEEKDATA, tid, arg, NULL);
+    }
+#endif
+    return (flags & CLONE_THREAD) != 0;
+}
+
+static
+bool is_clone(int syscall_id) {
+#ifdef SYS_clone3
+    if (syscall_id == SYS_clone3) return true;
+#endif
+    return syscall_id == SYS_clone;
+}
+
+/*
+ * 结束用户程序，多线程模式下停下的可能不是主线程，要给整个线程组发信号
+ * seccomp监控时没有跟踪关系，直接发信号
+ */
+static
+void kill_executive(pid_t executive) {
+    if (!PROBLEM::seccomp) {
+        ptrace(PTRACE_KILL, executive, NULL, NULL);
+    }
+    if (PROBLEM::threads > 0 || PROBLEM::seccomp) {
+        kill(executive, SIGKILL);
+    }
+}
+
+/*
+ * 跟踪进程的调度和ptrace停顿的延迟统计
+ * 用户程序每次停下都要等跟踪进程被调度才能继续，机器繁忙时这段等待可能长达几个时钟周期。
+ * 开启后跟踪进程在跟踪期间以SCHED_FIFO运行，有分配的CPU时固定在用户程序所在物理核心的
+ * 超线程兄弟上；优先级有上限，并用RLIMIT_RTTIME防止跟踪进程失控占住CPU
+ */
+const int TRACER_BUCKETS = 40;
+
+struct tracer_stats {
+    long long stops;
+    long long resume_ns;    //从wait4返回到PTRACE_SYSCALL返回
+    long long resume_max_ns;
+    long long buckets[TRACER_BUCKETS];  //第i个桶是[2^i, 2^(i+1)) ns
+    long long run_delay_ns; //跟踪进程在运行队列里等待的时间，来自schedstat
+    int priority;           //实际使用的优先级，0表示普通调度
+    int cpu;
+};
+static tracer_stats tracer;
+static volatile sig_atomic_t tracer_demoted = 0;
+
+static
+long long monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static
+long long tracer_run_delay() {
+    long long run = 0, delay = 0;
+    FILE *fp = fopen("/proc/thread-self/schedstat", "r");
+    if (fp != NULL) {
+        if (2 != fscanf(fp, "%lld %lld", &run, &delay)) {
+            delay = 0;
+        }
+        fclose(fp);
+    }
+    return delay;
+}
+
+static
+void tracer_xcpu(int /*signo*/) {
+    struct sched_param param = {0};
+    sched_setscheduler(0, SCHED_OTHER, &param);
+    tracer_demoted = 1;
+}
+
+/*
+ * 开始跟踪前提高跟踪进程的优先级，用户程序已经fork出去，不会继承
+ */
+static
+void tracer_boost(cpu_set_t &saved) {
+    tracer.priority = 0;
+    tracer.cpu = -1;
+    sched_getaffinity(0, sizeof(saved), &saved);
+    if (PROBLEM::tracer_priority <= 0) {
+        return;
+    }
+
+    //超线程兄弟忙时用户程序的CPU时间会变长，所以避开所有用户程序的物理核心；
+    //各个Core按占用的CPU错开，没有这样的CPU时不固定
+    int cpu = -1;
+    if (PROBLEM::judge_cpu >= 0) {
+        cpu_set_t rest = saved;
+        cpu_clear_slots(rest);
+        int count = CPU_COUNT(&rest), k = PROBLEM::judge_cpu % std::max(count, 1);
+        for (int i = 0; i < CPU_SETSIZE && count > 0; i++) {
+            if (CPU_ISSET(i, &rest) && k-- == 0) {
+                cpu = i;
+                break;
+            }
+        }
+    }
+    if (cpu >= 0) {
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        CPU_SET(cpu, &mask);
+        if (sched_setaffinity(0, sizeof(mask), &mask) == 0) {
+            tracer.cpu = cpu;
+        }
+    }
+
+    struct rlimit lim;
+    lim.rlim_cur = JUDGE_CONF::TRACER_RTTIME;
+    lim.rlim_max = JUDGE_CONF::TRACER_RTTIME * 2;   //软限制时降级，硬限制时被杀
+    setrlimit(RLIMIT_RTTIME, &lim);
+    signal(SIGXCPU, tracer_xcpu);
+
+    struct sched_param param;
+    param.sched_priority = std::min(PROBLEM::tracer_priority, JUDGE_CONF::TRACER_MAX_PRIORITY);
+    if (sched_setscheduler(0, SCHED_FIFO | SCHED_RESET_ON_FORK, &param) < 0) {
+        FM_LOG_WARNING("sched_setscheduler(SCHED_FIFO, %d) failed, %d: %s",
+                param.sched_priority, errno, strerror(errno));
+        return;
+    }
+    tracer.priority = param.sched_priority;
+}
+
+static
+void tracer_restore(const cpu_set_t &saved) {
+    if (PROBLEM::tracer_priority <= 0) {
+        return;
+    }
+    struct sched_param param = {0};
+    sched_setscheduler(0, SCHED_OTHER, &param);
+    sched_setaffinity(0, sizeof(saved), &saved);
+    signal(SIGXCPU, SIG_DFL);
+    if (tracer_demoted) {
+        FM_LOG_WARNING("tracer ran over RLIMIT_RTTIME, demoted to SCHED_OTHER");
+        tracer.priority = 0;
+    }
+}
+
+static
+void tracer_record(long long stopped_ns) {
+    long long ns = monotonic_ns() - stopped_ns;
+    tracer.stops++;
+    tracer.resume_ns += ns;
+    tracer.resume_max_ns = std::max(tracer.resume_max_ns, ns);
+    int bucket = 0;
+    while (bucket + 1 < TRACER_BUCKETS && (2LL << bucket) <= ns) {
+        bucket++;
+    }
+    tracer.buckets[bucket]++;
+}
+
+/*
+ * 停顿延迟的报告，百分位取所在桶的上界
+ */
+static
+void report_tracer() {
+    long long p50 = 0, p99 = 0, seen = 0;
+    for (int i = 0; i < TRACER_BUCKETS; i++) {
+        seen += tracer.buckets[i];
+        if (p50 == 0 && seen * 2 >= tracer.stops) p50 = 2LL << i;
+        if (p99 == 0 && seen * 100 >= tracer.stops * 99) p99 = 2LL << i;
+    }
+    p50 = std::min(p50, tracer.resume_max_ns);
+    p99 = std::min(p99, tracer.resume_max_ns);
+    long long stops = std::max(tracer.stops, 1LL);
+    add_report("[tracer]");
+    add_report("priority %d", tracer.priority);
+    add_report("cpu %d", tracer.cpu);
+    add_report("stops %lld", tracer.stops);
+    add_report("resume_avg_ns %lld", tracer.resume_ns / stops);
+    add_report("resume_p50_ns %lld", p50);
+    add_report("resume_p99_ns %lld", p99);
+    add_report("resume_max_ns %lld", tracer.resume_max_ns);
+    add_report("run_delay_avg_ns %lld", tracer.run_delay_ns / stops);
+}
+
+/*
+ * 用户程序结束（或者停在SIGTRAP以外的信号上）时根据状态给出结果，ptrace和seccomp监控共用
+ * 正常退出时结果不变，留给后面比对
+ */
+static
+void termination_result(int status) {
+    //自行退出
+    if (WIFEXITED(status)) {
+        if (PROBLEM::lang != JUDGE_CONF::LANG_JAVA ||
+            WEXITSTATUS(status) == EXIT_SUCCESS) {
+            FM_LOG_TRACE("OK, normal quit. All is good.");
+
+            //PROBLEM::result = JUDGE_CONF::PROCEED;
+        } else {
+            FM_LOG_WARNING("oh, some error occured.Abnormal quit.");
+            PROBLEM::result = JUDGE_CONF::RE;
+        }
+        return;
+    }
+
+    //被信号终止掉了
+    int signo = 0;
+    if (WIFSIGNALED(status)) {
+        signo = WTERMSIG(status);
+        FM_LOG_WARNING("child signaled by %d : %s", signo, strsignal(signo));
+    } else {
+        signo = WSTOPSIG(status);
+        FM_LOG_WARNING("child stop by %d : %s\n", signo, strsignal(signo));
+    }
+
+    switch (signo) {
+        //TLE
+        case SIGALRM:
+        case SIGXCPU:
+        case SIGVTALRM:
+        case SIGKILL:
+            FM_LOG_TRACE("Well, Time Limit Exeeded");
+            PROBLEM::time_usage = 0;
+            PROBLEM::memory_usage = 0;
+            PROBLEM::result = JUDGE_CONF::TLE;
+            break;
+        case SIGXFSZ:
+            FM_LOG_TRACE("File Limit Exceeded");
+            PROBLEM::time_usage = 0;
+            PROBLEM::memory_usage = 0;
+            PROBLEM::result = JUDGE_CONF::OLE;
+            break;
+        case SIGSEGV:
+        case SIGFPE:
+        case SIGBUS:
+        case SIGABRT:
+            //FM_LOG_TRACE("RE了");
+            PROBLEM::time_usage = 0;
+            PROBLEM::memory_usage = 0;
+            PROBLEM::result = JUDGE_CONF::RE;
+            break;
+        default:
+            //FM_LOG_TRACE("不知道哪儿跪了");
+            PROBLEM::time_usage = 0;
+            PROBLEM::memory_usage = 0;
+            PROBLEM::result = JUDGE_CONF::RE;
+            break;
+    }
+}
+
+/*
+ * seccomp监控下总是交给评测进程的系统调用，表中不限次数也一样：
+ * execve标志用户程序开始运行；brk、mmap、mremap处检查内存，和ptrace在每次停下时检查一样
+ */
+static const int SECCOMP_ALWAYS_NOTIFY[] = {SYS_execve, SYS_brk, SYS_mmap, SYS_mremap, -1};
+
+/*
+ * seccomp监控下检查一个被挂起的系统调用
+ * 不限次数的系统调用已经在内核里放行，到这里的是限次数的、要检查路径的、不允许的
+ * 以及SECCOMP_ALWAYS_NOTIFY中的。第一次execve之前是评测自己在exec（Java还要找java），
+ * 不检查，和ptrace从exec之后才开始跟踪一样
+ */
+static
+bool is_valid_notification(int listener, const struct seccomp_notif *req, bool &started) {
+    int syscall_id = req->data.nr;
+    if (syscall_id == SYS_execve) {
+        started = true;
+    }
+    if (!started) {
+        return true;
+    }
+    if (syscall_id < 0 || syscall_id >= (int)(sizeof(RF_table) / sizeof(RF_table[0]))) {
+        return false;
+    }
+    if (RF_table[syscall_id] < 0) {
+        return true;
+    }
+    if (RF_table[syscall_id] > 0) {
+        //ptrace在系统调用退出时减一，这里在进入时减一，允许的次数相同
+        RF_table[syscall_id]--;
+        return true;
+    }
+    if (syscall_id == SYS_open || syscall_id == SYS_openat) {
+        char filename[300];
+        unsigned long long addr = syscall_id == SYS_open ? req->data.args[0] : req->data.args[1];
+        if (!seccomp_notify_string(listener, req->id, req->pid, addr, filename, 257)) {
+            return false;
+        }
+        return is_valid_path(filename);
+    }
+    return false;
+}
+
+/*
+ * seccomp监控：等待通知或者用户程序结束，sync_fd是子进程写入通知fd号的管道
+ * 用户程序不在系统调用处停下，内存在brk、mmap、mremap处以及每隔SECCOMP_POLL_INTERVAL检查一次，
+ * 墙钟时间每隔SECCOMP_POLL_INTERVAL检查一次；
+ * 自己装了SIGALRM处理函数的程序在ptrace下也会在信号处停下被杀掉，这里由墙钟时间兜底。
+ * 返回时用户程序已经结束并回收，status和rused是wait4的结果
+ */
+static
+void supervise_notifications(pid_t executive, int sync_fd, int &status, struct rusage &rused,
+        unsigned long long &stops, long long &wall_start) {
+    int pidfd = -1;
+    int listener = seccomp_notify_attach(executive, sync_fd, pidfd);
+    close(sync_fd);
+    bool killed = false;
+
+    if (listener >= 0) {
+        size_t req_size, resp_size;
+        seccomp_notify_sizes(req_size, resp_size);
+        std::vector<long long> req_buf(req_size / sizeof(long long) + 1);
+        std::vector<long long> resp_buf(resp_size / sizeof(long long) + 1);
+        struct seccomp_notif *req = (struct seccomp_notif *)&req_buf[0];
+        struct seccomp_notif_resp *resp = (struct seccomp_notif_resp *)&resp_buf[0];
+
+        char name[64];
+        snprintf(name, sizeof(name), "/proc/%d/stat", (int)executive);
+        int stat_fd = open(name, O_RDONLY | O_CLOEXEC);
+        long ticks = sysconf(_SC_CLK_TCK);
+        long page_kb = getpagesize() / JUDGE_CONF::KILO;
+        int real_time_limit = run_time_limit();
+        bool started = false;
+
+        struct pollfd fds[2] = {{listener, POLLIN, 0}, {pidfd, POLLIN, 0}};
+        while (!killed) {
+            if (poll(fds, 2, JUDGE_CONF::SECCOMP_POLL_INTERVAL) < 0 && errno != EINTR) {
+                FM_LOG_WARNING("poll seccomp listener failed, %d: %s", errno, strerror(errno));
+                exit(JUDGE_CONF::EXIT_JUDGE);
+            }
+
+            //MLE，有通知时在放行之前检查
+            sample usage;
+            if (stat_fd >= 0 && sampler_read(stat_fd, -1, ticks, page_kb, usage)) {
+                PROBLEM::memory_usage = std::max((long long)PROBLEM::memory_usage, usage.minflt * page_kb);
+                progress_usage(usage.cpu_ms, PROBLEM::memory_usage);
+                if (PROBLEM::memory_usage > PROBLEM::memory_limit) {
+                    PROBLEM::time_usage = 0;
+                    PROBLEM::memory_usage = 0;
+                    PROBLEM::result = JUDGE_CONF::MLE;
+                    FM_LOG_TRACE("Well, Memory Limit Exceeded.");
+                    kill_executive(executive);
+                    killed = true;
+                    break;
+                }
+            }
+
+            if ((fds[0].revents & POLLIN) && seccomp_notify_recv(listener, req, req_size)) {
+                stops++;
+                int syscall_id = req->data.nr;
+                if (stops % JUDGE_CONF::TRACE_SYSCALL_SAMPLE == 0) {
+                    trace_instant("syscall", "nr", syscall_id);
+                }
+                bool before_exec = !started;
+                if (!is_valid_notification(listener, req, started)) {
+                    FM_LOG_WARNING("restricted fuction %d\n", syscall_id);
+                    PROBLEM::result = JUDGE_CONF::RE;
+                    kill_executive(executive);
+                    killed = true;
+                }
+                //第一次execve时挂上计数器，和ptrace下第一次停下时一样
+                if (before_exec && started) {
+                    wall_start = metrics_now_us();
+                    if (PROBLEM::profile) {
+                        perf_profile_open(executive);
+                    }
+                }
+                seccomp_notify_reply(listener, resp, resp_size, req->id, !killed);
+                if (killed) {
+                    break;
+                }
+            }
+
+            if (started && (metrics_now_us() - wall_start) / 1000 > real_time_limit) {
+                FM_LOG_TRACE("Well, Time Limit Exeeded");
+                PROBLEM::time_usage = 0;
+                PROBLEM::memory_usage = 0;
+                PROBLEM::result = JUDGE_CONF::TLE;
+                kill_executive(executive);
+                killed = true;
+                break;
+            }
+
+            if (fds[1].revents & POLLIN) {
+                break;  //用户程序已经结束
+            }
+        }
+        if (stat_fd >= 0) {
+            close(stat_fd);
+        }
+        close(listener);
+    }
+    if (pidfd >= 0) {
+        close(pidfd);
+    }
+
+    while (wait4(executive, &status, 0, &rused) < 0) {
+        if (errno != EINTR) {
+            FM_LOG_WARNING("wait4 failed.");
+            exit(JUDGE_CONF::EXIT_JUDGE);
+        }
+    }
+    if (killed) {
+        return;
+    }
+    termination_result(status);
+
+    //最后一次检查之后到退出之间用的内存
+    if (PROBLEM::result == JUDGE_CONF::SE) {
+        PROBLEM::memory_usage = std::max((long int)PROBLEM::memory_usage,
+                rused.ru_minflt * (getpagesize() / JUDGE_CONF::KILO));
+        if (PROBLEM::memory_usage > PROBLEM::memory_limit) {
+            PROBLEM::time_usage = 0;
+            PROBLEM::memory_usage = 0;
+            PROBLEM::result = JUDGE_CONF::MLE;
+            FM_LOG_TRACE("Well, Memory Limit Exceeded.");
+        }
+    }
+}
+
+/*
+ * 执行用户提交的程序，case_no是采样时记录的组号，0表示所有组在一次运行中
+ */
+static
+void judge(int case_no) {
+    struct rusage rused;
+    long long start_us = metrics_now_us();
+    unsigned long long stops = 0;   //ptrace停顿次数
+    trace_begin("run");
+
+    //独占物理核心（多线程模式下每个线程一个），直到这次运行结束
+    cpu_set_t claimed;      //用户程序所在的全部CPU，解压、采样进程避开它们
+    const cpu_set_t *avoid = NULL;
+    if (!PROBLEM::cpu_list.empty()) {
+        PROBLEM::judge_cpu = cpu_claim(JUDGE_CONF::CPU_WAIT_LIMIT, std::max(PROBLEM::threads, 1));
+        if (PROBLEM::judge_cpu < 0) {
+            exit(JUDGE_CONF::EXIT_CPU_ALLOC);
+        }
+        cpu_claimed_mask(claimed);
+        avoid = &claimed;
+        FM_LOG_TRACE("Run on %d cpus from cpu %d", CPU_COUNT(&claimed), PROBLEM::judge_cpu);
+    }
+
+    //压缩的输入由单独的进程解压到管道，避开用户程序所在的CPU
+    pid_t decompressor = -1;
+    const char *tool;
+    std::string input = resolve_data_file(PROBLEM::input_file, &tool);
+    if (tool != NULL) {
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) < 0) {
+            FM_LOG_WARNING("pipe for decompressor failed, %d: %s", errno, strerror(errno));
+            exit(JUDGE_CONF::EXIT_PRE_JUDGE);
+        }
+        decompressor = spawn_decompressor(input, tool, fds[1], avoid);
+        close(fds[1]);
+        if (decompressor < 0) {
+            exit(JUDGE_CONF::EXIT_PRE_JUDGE);
+        }
+        PROBLEM::input_fd = fds[0];
+    }
+
+    init_RF_table(PROBLEM::lang); //初始化系统调用表，seccomp监控时子进程按它生成过滤器
+    if (PROBLEM::threads > 0) {
+        allow_threads();
+    }
+    if (PROBLEM::landlock) {
+        //文件访问已经由Landlock在内核里限制，open不必再逐个检查路径
+        RF_table[SYS_open] = -1;
+        RF_table[SYS_openat] = -1;
+    }
+
+    //seccomp监控时子进程通过这个管道告诉父进程通知fd的编号
+    int sync_pipe[2] = {-1, -1};
+    if (PROBLEM::seccomp && pipe2(sync_pipe, O_CLOEXEC) < 0) {
+        FM_LOG_WARNING("pipe for seccomp failed, %d: %s", errno, strerror(errno));
+        exit(JUDGE_CONF::EXIT_PRE_JUDGE);
+    }
+
+    trace_begin("fork");
+    pid_t executive = fork();
+    if (executive < 0) {
+        exit(JUDGE_CONF::EXIT_PRE_JUDGE);
+    } else if (executive == 0) {
+        //子进程，用户程序
+        FM_LOG_TRACE("Start Judging.");
+        if (PROBLEM::judge_cpu >= 0) {
+            if (sched_setaffinity(0, sizeof(claimed), &claimed) < 0) {
+                FM_LOG_WARNING("sched_setaffinity(%d) failed, %d: %s", PROBLEM::judge_cpu, errno, strerror(errno));
+                exit(JUDGE_CONF::EXIT_SET_LIMIT);
+            }
+        }
+
+        trace_begin("security_control");
+        io_redirect();
+
+        std::vector<fs_rule> fs_rules;
+        if (PROBLEM::landlock) {
+            fs_rules = security_fs_rules();
+        }
+
+        security_control();
+
+        if (PROBLEM::landlock && !fs_policy_apply(fs_rules)) {
+            exit(JUDGE_CONF::EXIT_SET_SECURITY);
+        }
+        trace_end("security_control");
+
+        //多线程模式下CPU时间由RLIMIT_CPU限制所有线程之和，这里的定时器限制墙钟时间
+        int real_time_limit = PROBLEM::threads > 0 ? wall_time_limit() : run_time_limit();
+        if (EXIT_SUCCESS != malarm(ITIMER_REAL, real_time_limit)) {
+            exit(JUDGE_CONF::EXIT_PRE_JUDGE);
+        }
+
+        set_limit();
+
+        //独立的进程组，父进程只等待这个组里的线程，不会误收解压进程
+        if (PROBLEM::threads > 0 && setpgid(0, 0) < 0) {
+            exit(JUDGE_CONF::EXIT_PRE_JUDGE);
+        }
+
+        if (PROBLEM::seccomp) {
+            //评测进程意外退出时用户程序不能脱离监控继续运行，setuid之后设置才不会被清除
+            prctl(PR_SET_PDEATHSIG, SIGKILL);
+            int listener = seccomp_notify_install(RF_table, sizeof(RF_table) / sizeof(RF_table[0]),
+                    SECCOMP_ALWAYS_NOTIFY);
+            //装上过滤器之后只做不受限的write，execve要等父进程放行
+            if (listener < 0 ||
+                write(sync_pipe[1], &listener, sizeof(listener)) != sizeof(listener)) {
+                exit(JUDGE_CONF::EXIT_SET_SECURITY);
+            }
+        } else if (ptrace(PTRACE_TRACEME, 0, NULL, NULL) < 0) {
+            exit(JUDGE_CONF::EXIT_PRE_JUDGE_PTRACE);
+        }
+
+        trace_instant("exec");
+
+        if (PROBLEM::lang != JUDGE_CONF::LANG_JAVA){
+            execl("./a.out", "a.out", NULL);
+        } else {
+            exec_java();
+        }
+
+        //走到这了说明出错了
+        exit(JUDGE_CONF::EXIT_PRE_JUDGE_EXECLP);
+    } else {
+        //父进程
+        trace_end("fork");
+        if (PROBLEM::threads > 0) {
+            setpgid(executive, executive);  //和子进程里的setpgid谁先执行都可以
+        }
+        if (PROBLEM::input_fd >= 0) {
+            close(PROBLEM::input_fd);
+            PROBLEM::input_fd = -1;
+        }
+
+        int status = 0;  //子进程状态
+        int syscall_id = 0; //系统调用号
+        struct user_regs_struct regs; //寄存器
+
+        bool first_stop = true;
+        long long wall_start = metrics_now_us();
+
+        std::map<pid_t, bool> in_syscall;   //各线程是否在系统调用中
+        in_syscall[executive] = true;
+        int threads_alive = 1;
+        pid_t waited = PROBLEM::threads > 0 ? -executive : executive;
+
+        //采样进程在提高跟踪进程的优先级之前启动，不继承实时调度
+        int sampler_stop = -1;
+        pid_t sampler = -1;
+        if (PROBLEM::sample_interval > 0) {
+            sampler = spawn_sampler(executive, case_no, PROBLEM::sample_interval,
+                    PROBLEM::samples_file, avoid, sampler_stop);
+        }
+
+        cpu_set_t tracer_mask;
+        tracer_boost(tracer_mask);
+        long long run_delay = PROBLEM::tracer_priority >= 0 ? tracer_run_delay() : 0;
+        long long stopped_ns = 0;
+
+        if (PROBLEM::seccomp) {
+            close(sync_pipe[1]);
+            supervise_notifications(executive, sync_pipe[0], status, rused, stops, wall_start);
+        }
+
+        //不做系统调用的程序不会停下，定时打断wait4，从/proc刷新实时进度
+        timer_t progress_timer;
+        struct sigaction progress_old;
+        int progress_stat = -1;
+        bool progress_ticking = PROBLEM::progress && !PROBLEM::seccomp &&
+            progress_timer_start(JUDGE_CONF::PROGRESS_INTERVAL, progress_timer, progress_old);
+        if (progress_ticking) {
+            char name[64];
+            snprintf(name, sizeof(name), "/proc/%d/stat", (int)executive);
+            progress_stat = open(name, O_RDONLY | O_CLOEXEC);
+        }
+
+        while (!PROBLEM::seccomp) {//循环监控子进程
+            pid_t tid = wait4(waited, &status, __WALL, &rused);
+            if (tid < 0 && errno == EINTR) {
+                sample usage;
+                if (progress_stat >= 0 &&
+                    sampler_read(progress_stat, -1, sysconf(_SC_CLK_TCK), getpagesize() / JUDGE_CONF::KILO, usage)) {
+                    progress_usage(usage.cpu_ms, std::max((long long)PROBLEM::memory_usage,
+                                                          usage.minflt * (getpagesize() / JUDGE_CONF::KILO)));
+                }
+                continue;
+            }
+            if (tid < 0) {
+                FM_LOG_WARNING("wait4 failed.");
+                exit(JUDGE_CONF::EXIT_JUDGE);
+            }
+            stops++;
+            if (PROBLEM::tracer_priority >= 0) {
+                stopped_ns = monotonic_ns();
+            }
+
+            //第一次停下是在execve之后，此时挂上计数器只统计用户程序
+            if (first_stop && WIFSTOPPED(status)) {
+                first_stop = false;
+                wall_start = metrics_now_us();
+                if (PROBLEM::profile) {
+                    perf_profile_open(executive);
+                }
+                //Core崩溃时内核杀掉用户程序，否则它释放了核心锁还在占着核心
+                long options = PTRACE_O_EXITKILL | (PROBLEM::threads > 0 ? PTRACE_O_TRACECLONE : 0);
+                if (ptrace(PTRACE_SETOPTIONS, executive, NULL, options) < 0) {
+                    FM_LOG_WARNING("ptrace PTRACE_SETOPTIONS failed, %d: %s", errno, strerror(errno));
+                    exit(JUDGE_CONF::EXIT_JUDGE);
+                }
+            }
+
+            //主线程以外的线程退出，或者新线程第一次停下(SIGSTOP)
+            if (tid != executive) {
+                if (WIFEXITED(status) || WIFSIGNALED(status)) {
+                    in_syscall.erase(tid);
+                    threads_alive--;
+                    continue;
+                }
+                if (in_syscall.find(tid) == in_syscall.end()) {
+                    in_syscall[tid] = false;
+                    ptrace(PTRACE_SYSCALL, tid, NULL, NULL);
+                    continue;
+                }
+            }
+            //clone事件，新线程另外会停下
+            if (WIFSTOPPED(status) && (status >> 16) == PTRACE_EVENT_CLONE) {
+                ptrace(PTRACE_SYSCALL, tid, NULL, NULL);
+                continue;
+            }
+
+            //自行退出
+            if (WIFEXITED(status)) {
+                termination_result(status);
+                break;
+            }
+
+            //被信号终止掉了
+            if (WIFSIGNALED(status) ||
+                (WIFSTOPPED(status) && WSTOPSIG(status) != SIGTRAP)) { //要过滤掉SIGTRAP信号
+                termination_result(status);
+                kill_executive(executive);
+                break;
+            }
+
+            //MLE
+            PROBLEM::memory_usage = std::max((long int)PROBLEM::memory_usage,
+                    rused.ru_minflt * (getpagesize() / JUDGE_CONF::KILO));
+            //停下的子进程由wait4带回的用量就是到目前为止的用量
+            progress_usage(rused.ru_utime.tv_sec * 1000 + rused.ru_utime.tv_usec / 1000 +
+                           rused.ru_stime.tv_sec * 1000 + rused.ru_stime.tv_usec / 1000,
+                           PROBLEM::memory_usage);
+
+            if (PROBLEM::memory_usage > PROBLEM::memory_limit) {
+                PROBLEM::time_usage = 0;
+                PROBLEM::memory_usage = 0;
+                PROBLEM::result = JUDGE_CONF::MLE;
+                FM_LOG_TRACE("Well, Memory Limit Exceeded.");
+                kill_executive(executive);
+                break;
+            }
+
+            //获得子进程的寄存器，目的是为了获知其系统调用
+            if (ptrace(PTRACE_GETREGS, tid, NULL, &regs) < 0) {
+                FM_LOG_WARNING("ptrace PTRACE_GETREGS failed");
+                exit(JUDGE_CONF::EXIT_JUDGE);
+            }
+
+#ifdef __i386__
+            syscall_id = regs.orig_eax;
+#else
+            syscall_id = regs.orig_rax;
+#endif
+            if (stops % JUDGE_CONF::TRACE_SYSCALL_SAMPLE == 0) {
+                trace_instant("syscall", "nr", syscall_id);
+            }
+            //检查系统调用是否合法
+            if (syscall_id > 0 &&
+                !is_valid_syscall(PROBLEM::lang, syscall_id, tid, regs, in_syscall[tid])) {
+                FM_LOG_WARNING("restricted fuction %d\n", syscall_id);
+                if (syscall_id == SYS_rt_sigprocmask){
+                    FM_LOG_WARNING("The glibc failed.");
+                } else {
+                    //FM_LOG_WARNING("%d\n", SYS_write);
+                    FM_LOG_WARNING("restricted fuction table");
+                }
+                PROBLEM::result = JUDGE_CONF::RE;
+                kill_executive(executive);
+                break;
+            }
+
+            //只允许创建线程，并且同时存在的线程数不超过限制
+            if (PROBLEM::threads > 0 && is_clone(syscall_id)) {
+                if (in_syscall[tid]) {
+                    if (!clone_creates_thread(tid, syscall_id, regs) || threads_alive >= PROBLEM::threads) {
+                        FM_LOG_WARNING("clone refused, %d threads alive", threads_alive);
+                        PROBLEM::result = JUDGE_CONF::RE;
+                        kill_executive(executive);
+                        break;
+                    }
+                    threads_alive++;
+#ifdef __i386__
+                } else if ((long)regs.eax < 0) {
+#else
+                } else if ((long)regs.rax < 0) {
+#endif
+                    threads_alive--;    //clone失败
+                }
+            }
+
+            if (ptrace(PTRACE_SYSCALL, tid, NULL, NULL) < 0) {
+                FM_LOG_WARNING("ptrace PTRACE_SYSCALL failed.");
+                exit(JUDGE_CONF::EXIT_JUDGE);
+            }
+            if (PROBLEM::tracer_priority >= 0) {
+                tracer_record(stopped_ns);
+            }
+        }
+        PROBLEM::wall_usage = (metrics_now_us() - wall_start) / 1000;
+        if (progress_ticking) {
+            progress_timer_stop(progress_timer, progress_old);
+        }
+        if (progress_stat >= 0) {
+            close(progress_stat);
+        }
+        if (PROBLEM::tracer_priority >= 0) {
+            tracer.run_delay_ns += tracer_run_delay() - run_delay;
+        }
+        tracer_restore(tracer_mask);
+
+        if (PROBLEM::threads > 0) {
+            //被杀掉时其余线程还没有回收
+            while (wait4(-executive, NULL, __WALL, NULL) > 0) {
+            }
+        }
+        finish_sampler(sampler, sampler_stop);
+    }
+
+    if (PROBLEM::profile) {
+        perf_profile_close();
+    }
+
+    //用户程序自己结束时输入要完整，解压失败就不能按输出判断；TLE等已有结果时直接结束解压
+    if (!finish_decompressor(decompressor, PROBLEM::result == JUDGE_CONF::SE)) {
+        FM_LOG_WARNING("Decompressing %s failed.", input.c_str());
+        exit(JUDGE_CONF::EXIT_PRE_JUDGE);
+    }
+
+    if (metrics != NULL) {
+        metrics_add(&metrics->ptrace_stops, stops);
+        metrics_observe(METRIC_RUN, start_us);
+    }
+    trace_end("run");
+
+    cpu_release();
+    PROBLEM::judge_cpu = -1;
+
+    //这儿关于time_usage和memory_usage计算的有点混乱
+    //主要是为了减轻web的任务
+    //只要不是AC，就把time_usage和memory_usage归0
+    if (PROBLEM::result == JUDGE_CONF::SE){
+        PROBLEM::time_usage += (rused.ru_utime.tv_sec * 1000 +
+                                rused.ru_utime.tv_usec / 1000);
+        PROBLEM::time_usage += (rused.ru_stime.tv_sec * 1000 +
+                                rused.ru_stime.tv_usec / 1000);
+    }
+
+    //扣除ptrace停顿的开销，不低于用户态时间：开销都记在内核态
+    PROBLEM::stops = stops;
+    PROBLEM::raw_time_usage = PROBLEM::time_usage;
+    if (PROBLEM::overhead && PROBLEM::result == JUDGE_CONF::SE) {
+        int user_ms = rused.ru_utime.tv_sec * 1000 + rused.ru_utime.tv_usec / 1000;
+        int overhead_ms = (int)(stops * PROBLEM::stop_cost_ns / 1e6);
+        PROBLEM::time_usage = std::max(user_ms, PROBLEM::time_usage - overhead_ms);
+        if (PROBLEM::time_usage > PROBLEM::time_limit) {
+            FM_LOG_TRACE("Time Limit Exceeded, %d ms after %d stops", PROBLEM::time_usage, (int)stops);
+            PROBLEM::time_usage = 0;
+            PROBLEM::memory_usage = 0;
+            PROBLEM::result = JUDGE_CONF::TLE;
+        }
+    }
+
+    //RLIMIT_CPU只精确到秒，多线程模式下CPU时间和墙钟时间都要再检查一次
+    if (PROBLEM::threads > 0 && PROBLEM::result == JUDGE_CONF::SE &&
+        (PROBLEM::time_usage > PROBLEM::time_limit || PROBLEM::wall_usage > wall_time_limit())) {
+        FM_LOG_TRACE("Time Limit Exceeded, cpu %d ms, wall %d ms", PROBLEM::time_usage, PROBLEM::wall_usage);
+        PROBLEM::time_usage = 0;
+        PROBLEM::memory_usage = 0;
+        PROBLEM::result = JUDGE_CONF::TLE;
+    }
+
+}
+
+static
+int compare_output(std::string file_std, std::string file_exec) {
+    //这里可以不用写的
+    //仔细研究一下diff及其参数即可
+    //实现各种功能
+    long long start_us = metrics_now_us();
+    trace_begin("compare");
+    pid_t decompressor;
+    FILE *fp_std = open_data_file(file_std, decompressor, NULL);
+    if (fp_std == NULL) {
+        FM_LOG_WARNING("Open standard output file failed.");
+        exit(JUDGE_CONF::EXIT_COMPARE);
+    }
+
+    FILE *fp_exe = fopen(file_exec.c_str(), "r");
+    if (fp_exe == NULL) {
+        FM_LOG_WARNING("Open executive output file failed.");
+        exit(JUDGE_CONF::EXIT_COMPARE);
+    }
+    int a, b, Na = 0, Nb = 0;
+    enum {
+        AC = JUDGE_CONF::AC,
+        PE = JUDGE_CONF::PE,
+        WA = JUDGE_CONF::WA
+    }status = AC;
+    while (true) {
+        a = fgetc(fp_std);
+        b = fgetc(fp_exe);
+        Na++, Nb++;
+
+        //统一\r和\n之间的区别
+        if (a == '\r') {
+            a = fgetc(fp_std);
+            Na++;
+        }
+        if (b == '\r') {
+            b = fgetc(fp_std);
+            Nb++;
+        }
+#define is_space_char(a) ((a == ' ') || (a == '\t') || (a == '\n'))
+
+        if (feof(fp_std) && feof(fp_exe)){
+            //文件结束
+            break;
+        } else if (feof(fp_std) || feof(fp_exe)) {
+            //如果只有一个文件结束
+            //但是另一个文件的末尾是回车
+            //那么也当做AC处理
+            FILE *fp_tmp;
+            if (feof(fp_std)) {
+                if (!is_space_char(b)) {
+                    FM_LOG_TRACE("Well, Wrong Answer.");
+                    status = WA;
+                    break;
+                }
+                fp_tmp = fp_exe;
+            } else {
+                if (!is_space_char(a)) {
+                    FM_LOG_TRACE("Well, Wrong Answer.");
+                    status = WA;
+                    break;
+                }
+                fp_tmp = fp_std;
+            }
+            int c;
+            while ((c = fgetc(fp_tmp)) != EOF) {
+                if (c == '\r') c = '\n';
+                if (!is_space_char(c)) {
+                    FM_LOG_TRACE("Well, Wrong Answer.");
+                    status = WA;
+                    break;
+                }
+            }
+            break;
+        }
+
+        //如果两个字符不同
+        if (a != b) {
+            status = PE;
+            //过滤空白字符
+            if (is_space_char(a) && is_space_char(b)) {
+                continue;
+            }
+            if (is_space_char(a)) {
+                //a是空白字符，过滤，退回b以便下一轮循环
+                ungetc(b, fp_exe);
+                Nb--;
+            } else if (is_space_char(b)) {
+                ungetc(a, fp_std);
+                Na--;
+            } else {
+                FM_LOG_TRACE("Well, Wrong Answer.");
+                status = WA;
+                break;
+            }
+        }
+    }
+    //读到结尾的标准输出要检查解压是否成功，否则截断的数据可能被判为AC或WA
+    bool drained = feof(fp_std);
+    fclose(fp_std);
+    fclose(fp_exe);
+    if (!finish_decompressor(decompressor, drained)) {
+        FM_LOG_WARNING("Decompressing %s failed.", file_std.c_str());
+        exit(JUDGE_CONF::EXIT_COMPARE);
+    }
+    metrics_observe(METRIC_COMPARE, start_us);
+    trace_end("compare");
+    return status;
+}
+
+static
+void run_spj() {
+    // support ljudge style special judge
+    //多组测试数据时链接指向当前这一组
+    const std::string origin_name[3] = {
+        "." + PROBLEM::input_file.substr(PROBLEM::run_dir.size()),
+        "." + PROBLEM::output_file.substr(PROBLEM::run_dir.size()),
+        "." + PROBLEM::exec_output.substr(PROBLEM::run_dir.size())
+    };
+    const char target_name[4][16] = {"/input", "/output", "/user_output", "/user_code"};
+    std::vector<pid_t> decompressors;
+    long long start_us = metrics_now_us();
+    trace_begin("spj");
+    for (int i = 0; i < 4; i++)
+    {
+        std::string origin_path = (i != 3) ? origin_name[i] : PROBLEM::code_path;
+        std::string target_path = PROBLEM::run_dir + target_name[i];
+        unlink(target_path.c_str());
+
+        //压缩的测试数据用FIFO提供，解压结果不落盘
+        const char *tool = NULL;
+        std::string data_path = (i < 2) ? resolve_data_file(PROBLEM::run_dir + "/" + origin_path, &tool) : "";
+        if (tool != NULL) {
+            if (EXIT_SUCCESS != mkfifo(target_path.c_str(), 0644)) {
+                FM_LOG_WARNING("mkfifo(%s) failed, %d: %s", target_path.c_str(), errno, strerror(errno));
+                continue;
+            }
+            pid_t pid = spawn_decompressor(data_path, tool, -1, NULL, target_path.c_str());
+            if (pid > 0) decompressors.push_back(pid);
+            continue;
+        }
+
+        if (EXIT_SUCCESS != symlink(origin_path.c_str(), target_path.c_str()))
+            FM_LOG_WARNING("Create symbolic link from '%s' to '%s' failed,%d:%s.", origin_path.c_str(), target_path.c_str(), errno, strerror(errno));
+    }
+    trace_begin("fork");
+    pid_t spj_pid = fork();
+    int status = 0;
+    if (spj_pid < 0) {
+        FM_LOG_WARNING("fork for special judge failed.So sad.");
+        exit(JUDGE_CONF::EXIT_COMPARE_SPJ);
+    } else if (spj_pid == 0) {
+        FM_LOG_TRACE("Woo, I will start special judge!");
+        pid_t decompressor;
+        FILE *input = open_data_file(PROBLEM::input_file, decompressor, NULL); // ljudge style
+        if (input == NULL || dup2(fileno(input), STDIN_FILENO) < 0) {
+            stdin = NULL;
+        }
+        stdout = freopen(PROBLEM::spj_output_file.c_str(), "w", stdout);
+        if (stdin == NULL || stdout == NULL) {
+            FM_LOG_WARNING("redirect io in spj failed.");
+            exit(JUDGE_CONF::EXIT_COMPARE_SPJ);
+        }
+        //SPJ时间限制
+        if (EXIT_SUCCESS != malarm(ITIMER_REAL, JUDGE_CONF::SPJ_TIME_LIMIT)) {
+            FM_LOG_WARNING("Set time limit for spj failed.");
+            exit(JUDGE_CONF::EXIT_COMPARE_SPJ);
+        }
+
+        security_control_spj();
+
+        trace_instant("exec");
+        if (PROBLEM::spj_lang != JUDGE_CONF::LANG_JAVA) {
+            execl("./SpecialJudge", "SpecialJudge", "user_output", NULL);
+        } else {
+            execlp("java", "java", "SpecialJudge", NULL);
+        }
+
+        exit(JUDGE_CONF::EXIT_COMPARE_SPJ_FORK);
+    } else {
+        trace_end("fork");
+        if (wait4(spj_pid, &status, 0, NULL) < 0) {
+            FM_LOG_WARNING("wait4 failed.");
+            exit(JUDGE_CONF::EXIT_COMPARE_SPJ);
+        }
+        for (size_t i = 0; i < decompressors.size(); i++) {
+            finish_decompressor(decompressors[i]);
+        }
+        metrics_observe(METRIC_SPJ, start_us);
+        trace_end("spj");
+
+        if (WIFEXITED(status)) {
+            int spj_exit_code = WEXITSTATUS(status);
+            if (spj_exit_code >= 0 && spj_exit_code < 4) {
+                FM_LOG_TRACE("Well, SpecialJudge program normally quit.All is good.");
+                // 获取SPJ结果
+                switch (spj_exit_code) {
+                case 0:
+                    PROBLEM::result = JUDGE_CONF::AC;
+                    break;
+                case 1:
+                    PROBLEM::result = JUDGE_CONF::WA;
+                    break;
+                case 2:
+                    PROBLEM::result = JUDGE_CONF::PE;
+                    break;
+                }
+                return ;
+            } else {
+                FM_LOG_WARNING("I am sorry to tell you that the special judge program abnormally terminated. %d", WEXITSTATUS(status));
+            }
+        } else if (WIFSIGNALED(status) && WTERMSIG(status) == SIGALRM) {
+            FM_LOG_WARNING("Well, the special judge program consume too much time.");
+        } else {
+            FM_LOG_WARNING("Actually, I do not kwon why the special judge program dead.");
+        }
+    }
+}
+
+/*
+ * 比对用户程序的输出，得出最终结果
+ */
+static
+void compare_result() {
+    if (PROBLEM::spj) {
+        run_spj();
+    } else {
+        if (PROBLEM::result == JUDGE_CONF::SE)
+            PROBLEM::result = compare_output(PROBLEM::output_file, PROBLEM::exec_output);
+    }
+}
+
+/*
+ * 选定第i组测试数据（从1开始），0表示传统的单组in.in/out.out
+ */
+static
+void select_case(int i) {
+    if (i == 0) {
+        PROBLEM::input_file = PROBLEM::run_dir + "/in.in";
+        PROBLEM::output_file = PROBLEM::run_dir + "/out.out";
+        PROBLEM::exec_output = PROBLEM::run_dir + "/out.txt";
+        return;
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "/in%d.in", i);
+    PROBLEM::input_file = PROBLEM::run_dir + name;
+    snprintf(name, sizeof(name), "/out%d.out", i);
+    PROBLEM::output_file = PROBLEM::run_dir + name;
+    snprintf(name, sizeof(name), "/out%d.txt", i);
+    PROBLEM::exec_output = PROBLEM::run_dir + name;
+}
+
+/*
+ * 第i组测试数据（下标从0开始）在结果缓存中的键
+ */
+static
+cache_hash case_cache_key(int i) {
+    static cache_hash exec_hash = 0;
+    if (exec_hash == 0) {
+        exec_hash = hash_combine(FNV_OFFSET, PROBLEM::lang);
+        if (PROBLEM::lang == JUDGE_CONF::LANG_JAVA) {
+            exec_hash = hash_combine(exec_hash, hash_files_with_suffix(PROBLEM::run_dir, ".class"));
+        } else {
+            exec_hash = hash_combine(exec_hash, hash_file(PROBLEM::exec_file));
+        }
+    }
+
+    select_case(PROBLEM::case_count ? i + 1 : 0);
+    cache_hash key = exec_hash;
+    const char *tool;
+    key = hash_combine(key, hash_file(resolve_data_file(PROBLEM::input_file, &tool)));
+    key = hash_combine(key, hash_file(resolve_data_file(PROBLEM::output_file, &tool)));
+    key = hash_combine(key, PROBLEM::time_limit);
+    key = hash_combine(key, PROBLEM::memory_limit);
+    key = hash_combine(key, PROBLEM::spj ? PROBLEM::spj_lang : 0);
+    key = hash_combine(key, PROBLEM::spj ? hash_file(PROBLEM::spj_exec_file) : 0);
+    if (PROBLEM::threads > 0) {
+        key = hash_combine(key, PROBLEM::threads);
+        key = hash_combine(key, wall_time_limit());
+    }
+    //扣除停顿开销、监控方式、JudgeRunner都会影响用时和结果，不同选项的结果不能混用
+    int options = (PROBLEM::overhead ? 1 : 0) | (PROBLEM::landlock ? 2 : 0) | (PROBLEM::seccomp ? 4 : 0) |
+                  (PROBLEM::lang == JUDGE_CONF::LANG_JAVA && !PROBLEM::java_runner_dir.empty() ? 8 : 0);
+    if (options != 0) {
+        key = hash_combine(key, options);
+    }
+    return key;
+}
+
+/*
+ * 从缓存中取出键没有变化的测试数据的结果
+ * TLE以及用时接近时限的结果受机器负载影响，默认重新运行
+ */
+static
+void load_cached_cases() {
+    for (size_t i = 0; i < PROBLEM::cases.size(); i++) {
+        PROBLEM::case_result &c = PROBLEM::cases[i];
+        int result, time_usage, memory_usage;
+        if (!verdict_cache_get(case_cache_key(i), result, time_usage, memory_usage)) {
+            continue;
+        }
+        bool borderline = result == JUDGE_CONF::TLE ||
+            time_usage * 100 >= PROBLEM::time_limit * JUDGE_CONF::CACHE_RECHECK_PERCENT;
+        if (borderline && !JUDGE_CONF::CACHE_TRUST_BORDERLINE) {
+            FM_LOG_TRACE("case %d cached result %d %d ms is borderline, re-measure", (int)i + 1, result, time_usage);
+            continue;
+        }
+        c.result = result;
+        c.time_usage = time_usage;
+        c.memory_usage = memory_usage;
+        c.ran = true;
+        c.cached = true;
+    }
+}
+
+/*
+ * 把新得出的结果写入缓存，System Error不缓存
+ */
+static
+void store_cached_cases() {
+    int hits = 0, misses = 0;
+    for (size_t i = 0; i < PROBLEM::cases.size(); i++) {
+        const PROBLEM::case_result &c = PROBLEM::cases[i];
+        if (c.skipped) continue;
+        if (c.cached) {
+            hits++;
+            continue;
+        }
+        misses++;
+        if (c.result != JUDGE_CONF::SE) {
+            verdict_cache_put(case_cache_key(i), c.result, c.time_usage, c.memory_usage);
+        }
+    }
+    if (metrics != NULL) {
+        metrics_add(&metrics->cache_hits, hits);
+        metrics_add(&metrics->cache_misses, misses);
+    }
+    add_report("[cache]");
+    add_report("hits %d", hits);
+    add_report("misses %d", misses);
+}
+
+/*
+ * 是否用JudgeRunner在一个JVM里运行多组数据
+ */
+static
+bool java_runner_used() {
+    return PROBLEM::lang == JUDGE_CONF::LANG_JAVA && !PROBLEM::java_runner_dir.empty() &&
+           PROBLEM::case_count > 0;
+}
+
+/*
+ * 单JVM多组运行：JudgeRunner依次运行batch中还没运行过的组，每跑完一组就向状态文件写一行
+ *     序号 OK|RE|TLE CPU时间(ms) 堆内存峰值(KB)
+ * JudgeRunner按单组的时间限制自己结束超时的组；
+ * 没有写出状态的组（比如用户调用了System.exit、超时）之后再单独启动JVM运行
+ */
+static
+void run_java_runner(const std::vector<int> &batch) {
+    PROBLEM::java_runner_cases.clear();
+    for (size_t k = 0; k < batch.size(); k++) {
+        if (!PROBLEM::cases[batch[k]].ran) {
+            PROBLEM::java_runner_cases.push_back(batch[k]);
+        }
+    }
+    int count = PROBLEM::java_runner_cases.size();
+    if (count < 2) {    //只有一组时和单独启动JVM没有区别
+        PROBLEM::java_runner_cases.clear();
+        return;
+    }
+    unlink(PROBLEM::java_runner_status.c_str());
+
+    int time_limit = PROBLEM::time_limit;
+    int memory_limit = PROBLEM::memory_limit;
+    int wall_limit = PROBLEM::wall_limit;
+    PROBLEM::time_limit = time_limit * count;
+    PROBLEM::wall_limit = wall_limit * count;
+    PROBLEM::memory_limit = memory_limit * count;   //缺页数是累计的，整体放宽，每组单独检查
+    PROBLEM::input_file = "/dev/null";
+    PROBLEM::exec_output = PROBLEM::run_dir + "/runner_output.txt";
+    PROBLEM::result = JUDGE_CONF::SE;
+    PROBLEM::time_usage = 0;
+    PROBLEM::memory_usage = 0;
+
+    judge(0);
+
+    FM_LOG_TRACE("JudgeRunner finished %d cases, result %d", count, PROBLEM::result);
+    PROBLEM::java_runner_cases.clear();
+    PROBLEM::time_limit = time_limit;
+    PROBLEM::memory_limit = memory_limit;
+    PROBLEM::wall_limit = wall_limit;
+
+    FILE *fp = fopen(PROBLEM::java_runner_status.c_str(), "r");
+    if (fp == NULL) {
+        FM_LOG_WARNING("JudgeRunner left no status, fall back to one JVM per case.");
+        return;
+    }
+    int id, cpu, mem;
+    char verdict[16];
+    while (4 == fscanf(fp, "%d %15s %d %d", &id, verdict, &cpu, &mem)) {
+        if (id < 1 || id > PROBLEM::case_count) continue;
+        PROBLEM::case_result &c = PROBLEM::cases[id - 1];
+        c.ran = true;
+        c.time_usage = cpu;
+        c.memory_usage = mem;
+        if (strcmp(verdict, "TLE") == 0) {
+            c.result = JUDGE_CONF::TLE;
+        } else if (strcmp(verdict, "OK") != 0) {
+            c.result = JUDGE_CONF::RE;
+        } else if (cpu > time_limit) {
+            c.result = JUDGE_CONF::TLE;
+        } else if (mem > memory_limit) {
+            c.result = JUDGE_CONF::MLE;
+        } else {
+            c.result = JUDGE_CONF::SE;  //待比对
+            continue;
+        }
+        c.time_usage = c.memory_usage = 0;
+    }
+    fclose(fp);
+}
+
+/*
+ * 提前结束或按子任务评测时，order中from之后的组不一定都会运行，
+ * 所以每次只把之后最多batch组交给JudgeRunner，每批之后batch翻倍：
+ * 多跑的组不超过已经运行的组，JVM也只需启动对数次
+ */
+static
+void prefetch_java(const std::vector<int> &order, size_t from, int &batch) {
+    if (!java_runner_used() || PROBLEM::cases[order[from]].ran) {
+        return;
+    }
+    std::vector<int> next;
+    for (size_t k = from; k < order.size() && (int)next.size() < batch; k++) {
+        if (!PROBLEM::cases[order[k]].ran) {
+            next.push_back(order[k]);
+        }
+    }
+    batch *= 2;
+    run_java_runner(next);
+}
+
+/*
+ * 各组扣除停顿开销前后的CPU时间：序号 停顿次数 扣除前 扣除后
+ * 在运行阶段记录，批量评测时随附加报告传到比对阶段
+ */
+static
+void report_overhead() {
+    add_report("[overhead]");
+    add_report("stop_cost_ns %.1f", PROBLEM::stop_cost_ns);
+    for (size_t i = 0; i < PROBLEM::cases.size(); i++) {
+        const PROBLEM::case_result &c = PROBLEM::cases[i];
+        if (c.stops == 0) continue;     //来自缓存、被跳过或者由JudgeRunner运行
+        add_report("%d %lld %d %d", (int)i + 1, c.stops, c.raw_time_usage, c.time_usage);
+    }
+}
+
+/*
+ * 运行第i组测试数据（已经运行过的不再运行），compare为true时运行完立即比对
+ * 批量评测的运行阶段不比对，留给比对阶段
+ */
+static
+void run_case(int i, bool compare) {
+    PROBLEM::case_result &c = PROBLEM::cases[i];
+    select_case(PROBLEM::case_count ? i + 1 : 0);
+    trace_begin("case", "case", i + 1);
+    progress_case(i, PROGRESS_RUN);
+    if (!c.ran) {
+        if (PROBLEM::residency) {
+            const char *tool;
+            int hits = residency_touch(resolve_data_file(PROBLEM::input_file, &tool)) +
+                       residency_touch(resolve_data_file(PROBLEM::output_file, &tool));
+            if (metrics != NULL) {
+                metrics_add(&metrics->page_cache_hits, hits);
+                metrics_add(&metrics->page_cache_misses, 2 - hits);
+            }
+        }
+        PROBLEM::result = JUDGE_CONF::SE;
+        PROBLEM::time_usage = 0;
+        PROBLEM::memory_usage = 0;
+        PROBLEM::wall_usage = 0;
+        judge(i + 1);
+        c.result = PROBLEM::result;
+        c.time_usage = PROBLEM::time_usage;
+        c.memory_usage = PROBLEM::memory_usage;
+        c.wall_usage = PROBLEM::wall_usage;
+        c.raw_time_usage = PROBLEM::raw_time_usage;
+        c.stops = PROBLEM::stops;
+        c.ran = true;
+    }
+    if (compare && c.result == JUDGE_CONF::SE) {
+        progress_phase(PROGRESS_COMPARE);
+        PROBLEM::result = c.result;
+        compare_result();
+        c.result = PROBLEM::result;
+    }
+    if (c.result != JUDGE_CONF::SE) {
+        progress_verdict(i, c.result);
+    }
+    trace_end("case");
+}
+
+/*
+ * 这道题在失败统计中的键：组数和各组标准输出的哈希
+ */
+static
+cache_hash problem_key() {
+    cache_hash key = hash_combine(FNV_OFFSET, PROBLEM::case_count);
+    for (int i = 1; i <= PROBLEM::case_count; i++) {
+        select_case(i);
+        const char *tool;
+        key = hash_combine(key, hash_file(resolve_data_file(PROBLEM::output_file, &tool)));
+    }
+    return key;
+}
+
+static
+bool more_likely_to_fail(const std::pair<double, int> &a, const std::pair<double, int> &b) {
+    return a.first != b.first ? a.first > b.first : a.second < b.second;
+}
+
+/*
+ * 运行顺序：样例按文件顺序在前，其余按失败概率从高到低
+ */
+static
+std::vector<int> case_order(cache_hash problem) {
+    int n = PROBLEM::cases.size();
+    std::vector<case_stat> stats(n);
+    fail_stats_get(problem, stats);
+
+    std::vector<int> order;
+    std::vector<std::pair<double, int> > rest;
+    for (int i = 0; i < n; i++) {
+        if (i < PROBLEM::sample_count) {
+            order.push_back(i);
+        } else {
+            rest.push_back(std::make_pair(fail_rate(stats[i]), i));
+        }
+    }
+    std::sort(rest.begin(), rest.end(), more_likely_to_fail);
+    for (size_t i = 0; i < rest.size(); i++) {
+        order.push_back(rest[i].second);
+    }
+    return order;
+}
+
+/*
+ * 按失败概率排序运行，遇到第一个非AC就停下，其余的组标记为跳过；
+ * 要求报告按文件顺序的第一个失败时，再按文件顺序补跑它之前被跳过的组
+ */
+static
+void run_cases_until_failure(int n, bool compare) {
+    cache_hash problem = problem_key();
+    std::vector<int> order = case_order(problem);
+    int failed = -1, batch = 1;
+    for (size_t k = 0; k < order.size(); k++) {
+        if (failed >= 0) {
+            PROBLEM::cases[order[k]].skipped = true;
+            progress_verdict(order[k], PROGRESS_SKIPPED);
+            continue;
+        }
+        prefetch_java(order, k, batch);
+        run_case(order[k], compare);
+        if (PROBLEM::cases[order[k]].result != JUDGE_CONF::AC) {
+            failed = order[k];
+            FM_LOG_TRACE("case %d failed after %d cases", failed + 1, (int)k + 1);
+        }
+    }
+    if (PROBLEM::first_failure) {
+        std::vector<int> rest;  //失败的组之前被跳过的组
+        for (int i = 0; i < failed; i++) {
+            if (PROBLEM::cases[i].skipped) {
+                rest.push_back(i);
+            }
+        }
+        batch = 1;
+        for (size_t k = 0; k < rest.size(); k++) {
+            int i = rest[k];
+            PROBLEM::case_result &c = PROBLEM::cases[i];
+            c.skipped = false;
+            prefetch_java(rest, k, batch);
+            run_case(i, compare);
+            if (c.result != JUDGE_CONF::AC) {
+                for (int j = i + 1; j < failed; j++) {
+                    PROBLEM::cases[j].skipped = !PROBLEM::cases[j].ran;
+                }
+                break;
+            }
+        }
+    }
+
+    std::vector<case_stat> delta(n);
+    for (int i = 0; i < n; i++) {
+        const PROBLEM::case_result &c = PROBLEM::cases[i];
+        delta[i].runs = c.skipped ? 0 : 1;
+        delta[i].fails = !c.skipped && c.result != JUDGE_CONF::AC;
+    }
+    fail_stats_add(problem, delta);
+}
+
+/*
+ * 按子任务运行：子任务按文件顺序进行，某组失败后这个子任务其余的组、
+ * 以及依赖它的子任务中还没运行的组都跳过；跳过的组如果还属于后面能得分的子任务，到时照常运行。
+ * 不属于任何子任务的组最后运行
+ */
+static
+void run_subtasks(bool compare) {
+    int n = PROBLEM::cases.size();
+    std::vector<bool> done(n, false);
+    std::vector<bool> passed(PROBLEM::subtasks.size(), false);
+    for (size_t s = 0; s < PROBLEM::subtasks.size(); s++) {
+        const PROBLEM::subtask &t = PROBLEM::subtasks[s];
+        bool ok = true;
+        int batch = 1;
+        for (size_t d = 0; d < t.depends.size(); d++) {
+            ok = ok && passed[t.depends[d]];
+        }
+        for (size_t k = 0; k < t.cases.size(); k++) {
+            int i = t.cases[k];
+            if (!ok) {
+                if (!done[i] && !PROBLEM::cases[i].skipped) {
+                    PROBLEM::cases[i].skipped = true;
+                    progress_verdict(i, PROGRESS_SKIPPED);
+                }
+                continue;
+            }
+            if (!done[i]) {
+                PROBLEM::cases[i].skipped = false;
+                prefetch_java(t.cases, k, batch);
+                run_case(i, compare);
+                done[i] = true;
+            }
+            ok = PROBLEM::cases[i].result == JUDGE_CONF::AC;
+        }
+        passed[s] = ok;
+        if (!ok) {
+            FM_LOG_TRACE("subtask %d failed", (int)s + 1);
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        if (!done[i] && !PROBLEM::cases[i].skipped) {
+            run_case(i, compare);
+        }
+    }
+}
+
+/*
+ * 运行所有测试数据，开启失败统计时可能提前结束
+ */
+static
+void run_cases(bool compare) {
+    int n = std::max(PROBLEM::case_count, 1);
+    PROBLEM::case_result pending = {JUDGE_CONF::SE, 0, 0, false, false, 0, false, 0, 0};
+    PROBLEM::cases.assign(n, pending);
+    progress_cases(n);
+    if (PROBLEM::sample_interval > 0) {
+        unlink(PROBLEM::samples_file.c_str());  //各组的采样结果依次追加
+    }
+
+    pressure_policy policy = {
+        {JUDGE_CONF::RUN_PRESSURE_CPU, JUDGE_CONF::RUN_PRESSURE_MEMORY, JUDGE_CONF::RUN_PRESSURE_IO},
+        JUDGE_CONF::RUN_PRESSURE_WAIT
+    };
+    admit("run", policy);
+
+    if (!PROBLEM::cache_dir.empty()) {
+        load_cached_cases();
+    }
+
+    //按子任务运行时顺序由子任务决定，不再按失败概率排序
+    bool early_stop = compare && !PROBLEM::fail_stats_dir.empty() && PROBLEM::case_count > 1;
+    //所有组都会运行时一次交给JudgeRunner，否则在运行过程中分批交给它
+    if (java_runner_used() && !(compare && !PROBLEM::subtasks.empty()) && !early_stop) {
+        std::vector<int> all(n);
+        for (int i = 0; i < n; i++) {
+            all[i] = i;
+        }
+        run_java_runner(all);
+    }
+
+    if (compare && !PROBLEM::subtasks.empty()) {
+        run_subtasks(compare);
+    } else if (early_stop) {
+        run_cases_until_failure(n, compare);
+    } else {
+        for (int i = 0; i < n; i++) {
+            run_case(i, compare);
+        }
+    }
+
+    if (PROBLEM::tracer_priority >= 0) {
+        report_tracer();
+    }
+
+    if (PROBLEM::overhead) {
+        report_overhead();
+    }
+}
+
+/*
+ * 比对所有运行结果待定的测试数据
+ */
+static
+void compare_cases() {
+    for (size_t i = 0; i < PROBLEM::cases.size(); i++) {
+        PROBLEM::case_result &c = PROBLEM::cases[i];
+        if (c.result != JUDGE_CONF::SE || c.skipped) continue;
+        select_case(PROBLEM::case_count ? i + 1 : 0);
+        trace_begin("case", "case", i + 1);
+        progress_case(i, PROGRESS_COMPARE);
+        PROBLEM::result = c.result;
+        compare_result();
+        c.result = PROBLEM::result;
+        progress_verdict(i, c.result);
+        trace_end("case");
+    }
+}
+
+/*
+ * 子任务得分：组全部通过、依赖的子任务都得分时得到全部分值
+ * 每个子任务报告得分、分值、结果代号（第一个非AC的组的结果，依赖的子任务没有得分时为-1）和跳过的组数；
+ * 跳过的组逐个报告是因为哪个子任务失败而跳过的
+ */
+static
+void report_subtasks() {
+    int total = 0, full = 0;
+    std::vector<int> cause(PROBLEM::subtasks.size(), -1);    //没有得分时，失败的那个子任务
+    std::vector<std::string> lines;
+    char line[128];
+    for (size_t s = 0; s < PROBLEM::subtasks.size(); s++) {
+        const PROBLEM::subtask &t = PROBLEM::subtasks[s];
+        int result = JUDGE_CONF::AC, skipped = 0;
+        for (size_t d = 0; d < t.depends.size() && cause[s] < 0; d++) {
+            if (cause[t.depends[d]] >= 0) {
+                cause[s] = cause[t.depends[d]];
+                result = -1;
+            }
+        }
+        for (size_t k = 0; k < t.cases.size(); k++) {
+            const PROBLEM::case_result &c = PROBLEM::cases[t.cases[k]];
+            if (c.skipped) {
+                skipped++;
+            } else if (result == JUDGE_CONF::AC && c.result != JUDGE_CONF::AC) {
+                result = c.result;
+            }
+        }
+        if (cause[s] < 0 && (result != JUDGE_CONF::AC || skipped > 0)) {
+            cause[s] = s;
+        }
+        int score = cause[s] < 0 ? t.score : 0;
+        total += score;
+        full += t.score;
+        snprintf(line, sizeof(line), "%d %d %d %d %d", (int)s + 1, score, t.score, result, skipped);
+        lines.push_back(line);
+    }
+
+    add_report("[subtasks]");
+    add_report("score %d %d", total, full);
+    for (size_t i = 0; i < lines.size(); i++) {
+        add_report("%s", lines[i].c_str());
+    }
+
+    //跳过的组属于的子任务都没有得分，报告第一个的原因
+    add_report("[skipped]");
+    for (size_t i = 0; i < PROBLEM::cases.size(); i++) {
+        if (!PROBLEM::cases[i].skipped) continue;
+        for (size_t s = 0; s < PROBLEM::subtasks.size(); s++) {
+            const std::vector<int> &v = PROBLEM::subtasks[s].cases;
+            if (std::find(v.begin(), v.end(), (int)i) != v.end()) {
+                add_report("%d %d", (int)i + 1, cause[s] + 1);
+                break;
+            }
+        }
+    }
+}
+
+/*
+ * 汇总各组结果：按文件顺序第一个非AC的结果为最终结果，
+ * 时间和内存取各组的最大值，跳过的组不参与
+ */
+static
+void summarize_cases() {
+    PROBLEM::result = JUDGE_CONF::AC;
+    PROBLEM::time_usage = 0;
+    PROBLEM::memory_usage = 0;
+    for (size_t i = 0; i < PROBLEM::cases.size(); i++) {
+        const PROBLEM::case_result &c = PROBLEM::cases[i];
+        if (c.skipped) continue;
+        if (PROBLEM::result == JUDGE_CONF::AC && c.result != JUDGE_CONF::AC) {
+            PROBLEM::result = c.result;
+        }
+        PROBLEM::time_usage = std::max(PROBLEM::time_usage, c.time_usage);
+        PROBLEM::memory_usage = std::max(PROBLEM::memory_usage, c.memory_usage);
+    }
+
+    if (!PROBLEM::cache_dir.empty()) {
+        store_cached_cases();
+    }
+
+    if (PROBLEM::profile) {
+        add_report("[profile]");
+        for (int i = 0; i < PERF_COUNTER_NUM; i++) {
+            if (perf_total[i] < 0) {
+                add_report("%s unavailable", PERF_COUNTERS[i].name);
+            } else {
+                add_report("%s %lld", PERF_COUNTERS[i].name, perf_total[i]);
+            }
+        }
+    }
+
+    if (PROBLEM::calibrate) {
+        add_report("[speed]");
+        add_report("factor %.3f", PROBLEM::speed_factor);
+        add_report("time_limit %d", PROBLEM::time_limit);
+        add_report("normalized %d", (int)(PROBLEM::time_usage / PROBLEM::speed_factor + 0.5));
+    }
+
+    if (PROBLEM::threads > 0) {
+        add_report("[wall]");
+        for (size_t i = 0; i < PROBLEM::cases.size(); i++) {
+            add_report("%d %d", (int)i + 1, PROBLEM::cases[i].wall_usage);
+        }
+    }
+
+    if (PROBLEM::case_count > 0) {
+        add_report("[cases]");
+        for (size_t i = 0; i < PROBLEM::cases.size(); i++) {
+            const PROBLEM::case_result &c = PROBLEM::cases[i];
+            add_report("%d %d %d %d", (int)i + 1, c.skipped ? -1 : c.result, c.time_usage, c.memory_usage);
+        }
+    }
+
+    if (!PROBLEM::subtasks.empty()) {
+        report_subtasks();
+    }
+}
+
+/*
+ * 是否还有测试数据等待比对
+ */
+static
+bool has_pending_case() {
+    for (size_t i = 0; i < PROBLEM::cases.size(); i++) {
+        if (PROBLEM::cases[i].result == JUDGE_CONF::SE && !PROBLEM::cases[i].skipped) return true;
+    }
+    return false;
+}
+
+/*
+ * 批量评测
+ * 清单每行是一个提交：源代码路径 沙盒路径 时间限制 内存限制 [SpecialJudge语言 [测试数据组数]]
+ * 每个提交依次经过编译、运行、比对三个阶段，每个阶段都在单独的子进程中完成，
+ * 各阶段有独立的并发上限，后面提交的编译与前面提交的运行、比对可以同时进行。
+ * 阶段子进程以EXIT_BATCH_NEXT退出表示进入下一阶段，否则表示已得出结果，
+ * 结果照常写入各自沙盒的result.txt，并在完成时逐行输出到标准输出
+ */
+const int BATCH_COMPILE = 0;
+const int BATCH_RUN     = 1;
+const int BATCH_COMPARE = 2;
+
+struct batch_entry {
+    std::string code_path;
+    std::string run_dir;
+    int time_limit;
+    int memory_limit;
+    int spj_lang;   //0表示不是SpecialJudge
+    int case_count; //0表示只有in.in/out.out一组
+    int phase;      //当前所处的阶段
+};
+
+static
+void read_batch_manifest(std::vector<batch_entry> &entries) {
+    FILE *fp = fopen(PROBLEM::batch_file.c_str(), "r");
+    if (fp == NULL) {
+        FM_LOG_WARNING("Open batch manifest %s failed, %d: %s", PROBLEM::batch_file.c_str(), errno, strerror(errno));
+        exit(JUDGE_CONF::EXIT_BAD_PARAM);
+    }
+
+    char line[4096], code_path[2048], run_dir[2048];
+    while (fgets(line, sizeof(line), fp)) {
+        batch_entry e;
+        e.time_limit = 1000;
+        e.memory_limit = 65535;
+        e.spj_lang = 0;
+        e.case_count = 0;
+        e.phase = BATCH_COMPILE;
+        int n = sscanf(line, "%2047s %2047s %d %d %d %d", code_path, run_dir,
+                &e.time_limit, &e.memory_limit, &e.spj_lang, &e.case_count);
+        if (n <= 0 || code_path[0] == '#') {
+            continue;   //空行或注释
+        }
+        if (n < 2) {
+            FM_LOG_WARNING("Bad line in batch manifest: %s", line);
+            continue;
+        }
+        e.code_path = code_path;
+        e.run_dir = run_dir;
+        entries.push_back(e);
+    }
+    fclose(fp);
+    FM_LOG_TRACE("%d submissions in batch manifest", (int)entries.size());
+}
+
+/*
+ * 运行阶段和比对阶段在不同的进程里，运行结果通过沙盒中的文件传递
+ */
+static
+void save_run_state() {
+    FILE *fp = fopen(PROBLEM::run_state_file.c_str(), "w");
+    if (fp == NULL) {
+        FM_LOG_WARNING("Open run state file failed, %d: %s", errno, strerror(errno));
+        exit(JUDGE_CONF::EXIT_JUDGE);
+    }
+    fprintf(fp, "%d\n", (int)PROBLEM::cases.size());
+    for (size_t i = 0; i < PROBLEM::cases.size(); i++) {
+        const PROBLEM::case_result &c = PROBLEM::cases[i];
+        fprintf(fp, "%d %d %d %d %d\n", c.result, c.time_usage, c.memory_usage, (int)c.cached, c.wall_usage);
+    }
+    for (int i = 0; PROBLEM::profile && i < PERF_COUNTER_NUM; i++) {
+        fprintf(fp, "%lld\n", perf_total[i]);
+    }
+    fclose(fp);
+}
+
+static
+void load_run_state() {
+    FILE *fp = fopen(PROBLEM::run_state_file.c_str(), "r");
+    int n = 0;
+    if (fp == NULL || 1 != fscanf(fp, "%d", &n)) {
+        FM_LOG_WARNING("Load run state failed.");
+        exit(JUDGE_CONF::EXIT_COMPARE);
+    }
+    PROBLEM::case_result c = {JUDGE_CONF::SE, 0, 0, true, false, 0, false, 0, 0};
+    PROBLEM::cases.assign(n, c);
+    for (int i = 0; i < n; i++) {
+        PROBLEM::case_result &c = PROBLEM::cases[i];
+        int cached = 0;
+        if (5 != fscanf(fp, "%d %d %d %d %d", &c.result, &c.time_usage, &c.memory_usage, &cached, &c.wall_usage)) {
+            FM_LOG_WARNING("Load run state failed.");
+            exit(JUDGE_CONF::EXIT_COMPARE);
+        }
+        c.cached = cached != 0;
+    }
+    for (int i = 0; PROBLEM::profile && i < PERF_COUNTER_NUM; i++) {
+        if (1 != fscanf(fp, "%lld", &perf_total[i])) {
+            perf_total[i] = -1;
+        }
+    }
+    fclose(fp);
+}
+
+/*
+ * 附加报告也要跟着提交在各阶段进程间传递
+ */
+static
+void save_report() {
+    FILE *fp = fopen(PROBLEM::report_state_file.c_str(), "w");
+    if (fp == NULL) {
+        FM_LOG_WARNING("Open report state file failed, %d: %s", errno, strerror(errno));
+        return;
+    }
+    fprintf(fp, "%s", PROBLEM::report.c_str());
+    fclose(fp);
+}
+
+static
+void load_report() {
+    FILE *fp = fopen(PROBLEM::report_state_file.c_str(), "r");
+    if (fp == NULL) {
+        return;
+    }
+    char line[1024];
+    while (fgets(line, sizeof(line), fp)) {
+        PROBLEM::report += line;
+    }
+    fclose(fp);
+}
+
+/*
+ * 在子进程中执行某个提交的某个阶段，不会返回
+ */
+static
+void batch_phase(const batch_entry &e) {
+    PROBLEM::code_path    = e.code_path;
+    PROBLEM::run_dir      = e.run_dir;
+    PROBLEM::time_limit   = e.time_limit;
+    PROBLEM::memory_limit = e.memory_limit;
+    PROBLEM::spj          = e.spj_lang != 0;
+    PROBLEM::spj_lang     = e.spj_lang;
+    PROBLEM::case_count   = e.case_count;
+    metrics_owner = getpid();   //进入下一阶段时_exit，不会记录
+    prepare_problem();
+    start_trace(e.phase == BATCH_COMPILE);
+    start_progress(e.phase == BATCH_COMPILE);
+
+    //定时器不会被fork继承，每个阶段自己设置
+    if (EXIT_SUCCESS != malarm(ITIMER_REAL, JUDGE_CONF::JUDGE_TIME_LIMIT + std::max(PROBLEM::time_limit, wall_time_limit()))) {
+        FM_LOG_WARNING("Set the alarm for batch phase failed, %d: %s", errno, strerror(errno));
+        exit(JUDGE_CONF::EXIT_VERY_FIRST);
+    }
+
+    switch (e.phase) {
+        case BATCH_COMPILE:
+            setpriority(PRIO_PROCESS, 0, JUDGE_CONF::BATCH_COMPILE_NICE);
+            unlink(PROBLEM::report_state_file.c_str());
+            compiler_source_code();
+            save_report();
+            _exit(JUDGE_CONF::EXIT_BATCH_NEXT); //不写result.txt
+        case BATCH_RUN:
+            load_report();
+            prepare_java_cds_archive();
+            run_cases(!PROBLEM::fail_stats_dir.empty() || !PROBLEM::subtasks.empty());    //提前结束要依据比对结果
+            if (!has_pending_case()) {
+                summarize_cases();
+                exit(JUDGE_CONF::EXIT_OK);  //TLE、RE等已经是最终结果，不必再比对
+            }
+            save_run_state();
+            save_report();
+            _exit(JUDGE_CONF::EXIT_BATCH_NEXT);
+        default:
+            load_report();
+            load_run_state();
+            compare_cases();
+            summarize_cases();
+            exit(JUDGE_CONF::EXIT_OK);
+    }
+}
+
+/*
+ * 某个提交评测结束，把它的结果输出到标准输出
+ */
+static
+void report_batch_result(const batch_entry &e, int status) {
+    char verdict[256] = "System Error";
+    int time_usage = 0, memory_usage = 0;
+    std::string result_file = e.run_dir + "/result.txt";
+    FILE *fp = fopen(result_file.c_str(), "r");
+    if (fp != NULL) {
+        if (fgets(verdict, sizeof(verdict), fp)) {
+            verdict[strcspn(verdict, "\n")] = 0;
+        }
+        if (2 != fscanf(fp, "%d %d", &time_usage, &memory_usage)) {
+            time_usage = memory_usage = 0;
+        }
+        fclose(fp);
+    }
+    if (!WIFEXITED(status)) {
+        //阶段进程被信号杀死，没有机会写结果
+        FM_LOG_WARNING("batch phase of %s terminated abnormally", e.run_dir.c_str());
+        strcpy(verdict, "System Error");
+        time_usage = memory_usage = 0;
+    }
+    printf("%s\t%s\t%d\t%d\n", e.run_dir.c_str(), verdict, time_usage, memory_usage);
+    fflush(stdout);
+}
+
+static
+void run_batch() {
+    std::vector<batch_entry> entries;
+    read_batch_manifest(entries);
+
+    std::deque<int> queue[3];
+    int running[3] = {0, 0, 0};
+    const int limit[3] = {
+        JUDGE_CONF::BATCH_COMPILE_WORKERS,
+        JUDGE_CONF::BATCH_RUN_WORKERS,
+        JUDGE_CONF::BATCH_COMPARE_WORKERS
+    };
+    std::map<pid_t, int> owner;    //阶段进程 -> 提交的下标
+
+    //阶段进程继承超时的回调，超时时照常写出result.txt
+    signal(SIGALRM, timeout);
+    //每个提交由得出结果的阶段进程记录统计，调度进程自己不记录
+    metrics_owner = 0;
+
+    for (size_t i = 0; i < entries.size(); i++) {
+        queue[BATCH_COMPILE].push_back(i);
+    }
+
+    size_t finished = 0;
+    while (finished < entries.size()) {
+        //先推进靠后的阶段，让已经编译好的提交尽快出结果
+        for (int phase = BATCH_COMPARE; phase >= BATCH_COMPILE; phase--) {
+            while (running[phase] < limit[phase] && !queue[phase].empty()) {
+                int i = queue[phase].front();
+                queue[phase].pop_front();
+                pid_t pid = fork();
+                if (pid < 0) {
+                    FM_LOG_WARNING("fork for batch phase failed, %d: %s", errno, strerror(errno));
+                    exit(JUDGE_CONF::EXIT_PRE_JUDGE);
+                } else if (pid == 0) {
+                    batch_phase(entries[i]);
+                }
+                owner[pid] = i;
+                running[phase]++;
+            }
+        }
+
+        int status = 0;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            FM_LOG_WARNING("waitpid in batch failed, %d: %s", errno, strerror(errno));
+            exit(JUDGE_CONF::EXIT_JUDGE);
+        }
+        std::map<pid_t, int>::iterator it = owner.find(pid);
+        if (it == owner.end()) {
+            continue;
+        }
+        batch_entry &e = entries[it->second];
+        running[e.phase]--;
+        if (WIFEXITED(status) && WEXITSTATUS(status) == JUDGE_CONF::EXIT_BATCH_NEXT &&
+            e.phase < BATCH_COMPARE) {
+            e.phase++;
+            queue[e.phase].push_back(it->second);
+        } else {
+            report_batch_result(e, status);
+            finished++;
+        }
+        owner.erase(it);
+    }
+}
+
+/*
+ * 对拍
+ * 生成器以种子为参数输出一组输入，标程和提交分别运行，比对两者的输出，
+ * 种子依次为1到stress_count，找出第一个（种子最小的）出错的输入。
+ * 三个程序都只编译一次，之后由stress_workers个进程并行：第w个进程依次处理种子w+1、w+1+workers……，
+ * 每个进程有自己的一组文件stress<w>.in/ans/out。某个进程出错后记下种子并停下，
+ * 其余进程只处理更小的种子，所以结果和串行运行时一样是确定的。
+ * 生成器和标程同SpecialJudge一样视为可信的程序，不chroot、不跟踪，只限制运行时间；
+ * 提交照常在沙盒中运行，由compare_output比对。
+ * 出错的输入、标程输出、提交输出保存为运行目录下的hack.in、hack.ans、hack.out
+ */
+const int STRESS_GENERATOR_FAILED = -1;
+const int STRESS_REFERENCE_FAILED = -2;
+
+struct stress_failure {
+    int seed;       //0表示没有出错
+    int result;
+};
+
+//各进程共享的状态，后面接着每个进程一个stress_failure
+struct stress_state {
+    int first_seed;     //目前已知最小的出错种子
+    int checked;        //已经完成的组数
+    int time_usage;     //通过的组中最大的时间
+    int memory_usage;
+};
+
+static
+void atomic_max(int *p, int value) {
+    int old = *p;
+    while (old < value && !__sync_bool_compare_and_swap(p, old, value)) {
+        old = *p;
+    }
+}
+
+static
+void atomic_min(int *p, int value) {
+    int old = *p;
+    while (old > value && !__sync_bool_compare_and_swap(p, old, value)) {
+        old = *p;
+    }
+}
+
+/*
+ * 编译生成器或标程，编译错误时以CE结束，信息以label开头
+ */
+static
+void compile_stress_program(const std::string &source, const char *name, const char *label) {
+    std::string code_path = PROBLEM::code_path;
+    std::string exec_file = PROBLEM::exec_file;
+    int lang = PROBLEM::lang;
+
+    PROBLEM::code_path = source;
+    PROBLEM::exec_file = PROBLEM::run_dir + "/" + name;
+    if (has_suffix(source, ".cpp")) {
+        PROBLEM::lang = JUDGE_CONF::LANG_CPP;
+    } else if (has_suffix(source, ".c")) {
+        PROBLEM::lang = JUDGE_CONF::LANG_C;
+    } else {
+        FM_LOG_WARNING("%s must be C or C++: %s", label, source.c_str());
+        exit(JUDGE_CONF::EXIT_BAD_PARAM);
+    }
+    PROBLEM::extra_message = std::string(label) + ": ";
+    compiler_source_code();
+
+    PROBLEM::extra_message = "";
+    PROBLEM::code_path = code_path;
+    PROBLEM::exec_file = exec_file;
+    PROBLEM::lang = lang;
+}
+
+/*
+ * 运行生成器或标程，arg为NULL表示没有参数，返回是否正常结束
+ */
+static
+bool run_stress_helper(const char *name, const char *arg, const std::string &input, const std::string &output) {
+    pid_t pid = fork();
+    if (pid < 0) {
+        FM_LOG_WARNING("fork for %s failed, %d: %s", name, errno, strerror(errno));
+        return false;
+    } else if (pid == 0) {
+        if (freopen(input.c_str(), "r", stdin) == NULL ||
+            freopen(output.c_str(), "w", stdout) == NULL ||
+            chdir(PROBLEM::run_dir.c_str()) < 0) {
+            _exit(EXIT_FAILURE);
+        }
+        malarm(ITIMER_REAL, JUDGE_CONF::STRESS_HELPER_TIME_LIMIT);   //exec之后SIGALRM恢复默认处理，直接结束
+        execl(name, name, arg, NULL);
+        _exit(EXIT_FAILURE);    //不能触发atexit
+    }
+    int status = 0;
+    if (waitpid(pid, &status, 0) < 0) {
+        return false;
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+}
+
+/*
+ * 第w个对拍进程，不会返回
+ */
+static
+void stress_worker(int w, int workers, stress_state *state, stress_failure *failures) {
+    PROBLEM::result_file = "";  //只有主进程写result.txt
+    char name[64];
+    snprintf(name, sizeof(name), "/stress%d.in", w);
+    PROBLEM::input_file = PROBLEM::run_dir + name;
+    snprintf(name, sizeof(name), "/stress%d.ans", w);
+    PROBLEM::output_file = PROBLEM::run_dir + name;
+    snprintf(name, sizeof(name), "/stress%d.out", w);
+    PROBLEM::exec_output = PROBLEM::run_dir + name;
+
+    for (int seed = w + 1; seed <= PROBLEM::stress_count; seed += workers) {
+        if (seed > state->first_seed) {
+            break;
+        }
+        //每组重新计时，哪一步卡住都不会一直等下去
+        if (EXIT_SUCCESS != malarm(ITIMER_REAL, JUDGE_CONF::JUDGE_TIME_LIMIT +
+                    JUDGE_CONF::STRESS_HELPER_TIME_LIMIT * 2 + std::max(PROBLEM::time_limit, wall_time_limit()))) {
+            exit(JUDGE_CONF::EXIT_VERY_FIRST);
+        }
+        char arg[16];
+        snprintf(arg, sizeof(arg), "%d", seed);
+        int result;
+        if (!run_stress_helper("./generator", arg, "/dev/null", PROBLEM::input_file)) {
+            result = STRESS_GENERATOR_FAILED;
+        } else if (!run_stress_helper("./reference", NULL, PROBLEM::input_file, PROBLEM::output_file)) {
+            result = STRESS_REFERENCE_FAILED;
+        } else {
+            PROBLEM::result = JUDGE_CONF::SE;
+            PROBLEM::time_usage = 0;
+            PROBLEM::memory_usage = 0;
+            PROBLEM::wall_usage = 0;
+            judge(seed);
+            result = PROBLEM::result;
+            if (result == JUDGE_CONF::SE) {
+                result = compare_output(PROBLEM::output_file, PROBLEM::exec_output);
+            }
+            if (result == JUDGE_CONF::AC) {
+                atomic_max(&state->time_usage, PROBLEM::time_usage);
+                atomic_max(&state->memory_usage, PROBLEM::memory_usage);
+            }
+        }
+        __sync_fetch_and_add(&state->checked, 1);
+        if (result != JUDGE_CONF::AC) {
+            failures[w].seed = seed;
+            failures[w].result = result;
+            atomic_min(&state->first_seed, seed);
+            break;  //保留这一组的文件
+        }
+    }
+    _exit(JUDGE_CONF::EXIT_OK);
+}
+
+static
+void run_stress() {
+    compiler_source_code();
+    compile_stress_program(PROBLEM::stress_generator, "generator", "Generator");
+    compile_stress_program(PROBLEM::stress_reference, "reference", "Reference");
+
+    int workers = PROBLEM::stress_workers > 0 ? PROBLEM::stress_workers : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    workers = std::max(1, std::min(std::min(workers, JUDGE_CONF::STRESS_MAX_WORKERS), PROBLEM::stress_count));
+
+    size_t size = sizeof(stress_state) + workers * sizeof(stress_failure);
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        FM_LOG_WARNING("mmap for stress failed, %d: %s", errno, strerror(errno));
+        exit(JUDGE_CONF::EXIT_PRE_JUDGE);
+    }
+    stress_state *state = (stress_state *)p;
+    stress_failure *failures = (stress_failure *)(state + 1);
+    state->first_seed = PROBLEM::stress_count + 1;
+
+    const char *suffix[3] = {"in", "ans", "out"};
+    for (int i = 0; i < 3; i++) {
+        unlink((PROBLEM::run_dir + "/hack." + suffix[i]).c_str());  //上一次对拍留下的
+    }
+
+    long long start_us = metrics_now_us();
+    std::vector<pid_t> pids;
+    for (int w = 0; w < workers; w++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            FM_LOG_WARNING("fork for stress worker failed, %d: %s", errno, strerror(errno));
+            exit(JUDGE_CONF::EXIT_PRE_JUDGE);
+        } else if (pid == 0) {
+            stress_worker(w, workers, state, failures);
+        }
+        pids.push_back(pid);
+    }
+    bool aborted = false;
+    for (size_t i = 0; i < pids.size(); i++) {
+        int status = 0;
+        if (waitpid(pids[i], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != JUDGE_CONF::EXIT_OK) {
+            FM_LOG_WARNING("stress worker %d terminated abnormally", (int)i);
+            aborted = true;
+        }
+    }
+    double seconds = (metrics_now_us() - start_us) / 1e6;
+    if (aborted) {
+        exit(JUDGE_CONF::EXIT_JUDGE);
+    }
+
+    int failed = -1;
+    for (int w = 0; w < workers; w++) {
+        if (failures[w].seed > 0 && (failed < 0 || failures[w].seed < failures[failed].seed)) {
+            failed = w;
+        }
+    }
+
+    for (int w = 0; w < workers; w++) {
+        for (int i = 0; i < 3; i++) {
+            char from[64], to[64];
+            snprintf(from, sizeof(from), "/stress%d.%s", w, suffix[i]);
+            snprintf(to, sizeof(to), "/hack.%s", suffix[i]);
+            if (w == failed) {
+                rename((PROBLEM::run_dir + from).c_str(), (PROBLEM::run_dir + to).c_str());
+            } else {
+                unlink((PROBLEM::run_dir + from).c_str());
+            }
+        }
+    }
+
+    add_report("[stress]");
+    add_report("workers %d", workers);
+    add_report("checked %d", state->checked);
+    add_report("seconds %.3f", seconds);
+    add_report("cases_per_sec %.1f", seconds > 0 ? state->checked / seconds : 0.0);
+    add_report("failed_seed %d", failed < 0 ? 0 : failures[failed].seed);
+
+    if (failed < 0) {
+        PROBLEM::result = JUDGE_CONF::AC;
+        PROBLEM::time_usage = state->time_usage;
+        PROBLEM::memory_usage = state->memory_usage;
+        return;
+    }
+    char message[128];
+    int result = failures[failed].result;
+    if (result == STRESS_GENERATOR_FAILED || result == STRESS_REFERENCE_FAILED) {
+        snprintf(message, sizeof(message), "%s failed on seed %d",
+                result == STRESS_GENERATOR_FAILED ? "Generator" : "Reference", failures[failed].seed);
+        result = JUDGE_CONF::SE;
+    } else {
+        snprintf(message, sizeof(message), "Failed on seed %d, input saved as hack.in", failures[failed].seed);
+    }
+    FM_LOG_TRACE("%s", message);
+    PROBLEM::result = result;
+    PROBLEM::time_usage = 0;
+    PROBLEM::memory_usage = 0;
+    PROBLEM::extra_message = message;
+}
+
+int judge_main(int argc, char *argv[]) {
+
+    //日志要在解析其他参数之前打开，-l先单独找出来
+    const char *log_path = "./core_log.txt";
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "-l") == 0) {
+            log_path = argv[i + 1];
+        }
+    }
+    log_open(log_path);
+
+    optind = 1; //调用者可能用过getopt
+
+    atexit(output_trace);   //atexit的回调逆序执行，时间线在结果写完之后导出
+    atexit(output_result);  //退出程序时的回调函数，用于输出判题结果
+
+    main_pid = getpid();
+
+    //通过judge_run评测时结果同时写到调用者给的共享内存
+    const char *result_fd = getenv("LIBJUDGE_RESULT_FD");
+    if (result_fd != NULL) {
+        int fd = atoi(result_fd);
+        void *p = mmap(NULL, sizeof(judge_result), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) {
+            shared_result = (judge_result *)p;
+        }
+        close(fd);  //不能留给用户程序
+        unsetenv("LIBJUDGE_RESULT_FD");
+    }
+
+    parse_arguments(argc, argv);
+
+    if (PROBLEM::ns_pool_size > 0) {
+        //命名空间里的nobody会映射成运行池的用户，不能是root
+        if (geteuid() == 0) {
+            FM_LOG_FATAL("The namespace pool must run as the unprivileged judge user.");
+            exit(JUDGE_CONF::EXIT_BAD_PARAM);
+        }
+        struct passwd *nobody = getpwnam("nobody");
+        if (nobody == NULL || PROBLEM::ns_pool_dir.empty()) {
+            FM_LOG_FATAL("The namespace pool needs -U and the nobody user.");
+            exit(JUDGE_CONF::EXIT_BAD_PARAM);
+        }
+        ns_pool_manager(PROBLEM::ns_pool_dir, PROBLEM::ns_pool_size, nobody->pw_uid, nobody->pw_gid);
+    }
+
+    //为了构建沙盒，必须要有root权限；在命名空间池中评测时不需要
+    if (geteuid() != 0 && PROBLEM::ns_pool_dir.empty()) {
+        FM_LOG_FATAL("You must run this program as root.");
+        exit(JUDGE_CONF::EXIT_UNPRIVILEGED);
+    }
+
+    if (PROBLEM::residency_budget > 0) {
+        residency_manager((size_t)PROBLEM::residency_budget * JUDGE_CONF::MEGA,
+                PROBLEM::warm_dirs, JUDGE_CONF::RESIDENCY_INTERVAL);
+    }
+
+    if (!PROBLEM::batch_file.empty()) {
+        //批量评测由各阶段子进程各自输出结果
+        run_batch();
+        return 0;
+    }
+
+    if (!PROBLEM::stress_generator.empty()) {
+        //对拍由各进程分别计时，不设整体的时间限制
+        run_stress();
+        return 0;
+    }
+
+    JUDGE_CONF::JUDGE_TIME_LIMIT += std::max(PROBLEM::time_limit, wall_time_limit());
+
+    if (EXIT_SUCCESS != malarm(ITIMER_REAL, JUDGE_CONF::JUDGE_TIME_LIMIT)) {
+        FM_LOG_WARNING("Set the alarm for this judge program failed, %d: %s", errno, strerror(errno));
+        exit(JUDGE_CONF::EXIT_VERY_FIRST);
+    }
+    signal(SIGALRM, timeout);
+
+    start_trace(true);
+    start_progress(true);
+
+    compiler_source_code();
+
+    prepare_java_cds_archive();
+
+    run_cases(true);
+
+    summarize_cases();
+
+    return 0;
+}
+
+void judge_job_init(judge_job *job) {
+    memset(job, 0, sizeof(judge_job));
+    job->time_limit = 1000;
+    job->memory_limit = 65536;
+}
+
+int judge_run(const judge_job *job, judge_result *result) {
+    if (job == NULL || result == NULL || job->code_path == NULL || job->run_dir == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    std::vector<std::string> args;
+    char number[16];
+    args.push_back(job->core_path != NULL ? job->core_path : "Core");
+    args.push_back("-c"); args.push_back(job->code_path);
+    args.push_back("-d"); args.push_back(job->run_dir);
+    args.push_back("-l");
+    args.push_back(job->log_path != NULL ? job->log_path : std::string(job->run_dir) + "/core_log.txt");
+    snprintf(number, sizeof(number), "%d", job->time_limit);
+    args.push_back("-t"); args.push_back(number);
+    snprintf(number, sizeof(number), "%d", job->memory_limit);
+    args.push_back("-m"); args.push_back(number);
+    if (job->spj) {
+        snprintf(number, sizeof(number), "%d", job->spj_lang);
+        args.push_back("-s");
+        args.push_back("-S"); args.push_back(number);
+    }
+    if (job->case_count > 0) {
+        snprintf(number, sizeof(number), "%d", job->case_count);
+        args.push_back("-n"); args.push_back(number);
+    }
+    for (int i = 0; job->options != NULL && job->options[i] != NULL; i++) {
+        args.push_back(job->options[i]);
+    }
+    std::vector<char *> argv;
+    for (size_t i = 0; i < args.size(); i++) {
+        argv.push_back(const_cast<char *>(args[i].c_str()));
+    }
+    argv.push_back(NULL);
+
+    //结果通过memfd共享，Core在固定的fd号上找到它
+    int fd = memfd_create("judge_result", MFD_CLOEXEC);
+    if (fd >= 0 && fd == JUDGE_RESULT_FD) {
+        int moved = fcntl(fd, F_DUPFD_CLOEXEC, JUDGE_RESULT_FD + 1);
+        close(fd);
+        fd = moved;
+    }
+    if (fd < 0) {
+        return -1;
+    }
+    void *p = MAP_FAILED;
+    if (ftruncate(fd, sizeof(judge_result)) == 0) {
+        p = mmap(NULL, sizeof(judge_result), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (p == MAP_FAILED) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    judge_result *shared = (judge_result *)p;
+    shared->result = JUDGE_CONF::SE;
+    strcpy(shared->status, "System Error");
+
+    std::string env_fd = "LIBJUDGE_RESULT_FD=" + std::to_string(JUDGE_RESULT_FD);
+    std::vector<char *> envp;
+    for (char **e = environ; *e != NULL; e++) {
+        if (strncmp(*e, "LIBJUDGE_RESULT_FD=", 19) != 0) envp.push_back(*e);
+    }
+    envp.push_back(const_cast<char *>(env_fd.c_str()));
+    envp.push_back(NULL);
+
+    //调用者的线程可能屏蔽了信号或者设置了处理函数，Core需要默认的处理方式
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t none, all;
+    sigemptyset(&none);
+    sigfillset(&all);
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fd, JUDGE_RESULT_FD);
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+    posix_spawnattr_setsigmask(&attr, &none);
+    posix_spawnattr_setsigdefault(&attr, &all);
+
+    pid_t pid;
+    int err = posix_spawnp(&pid, argv[0], &actions, &attr, &argv[0], &envp[0]);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    close(fd);
+    if (err != 0) {
+        munmap(p, sizeof(judge_result));
+        errno = err;
+        return -1;
+    }
+
+    int status = 0;
+    pid_t waited;
+    while ((waited = waitpid(pid, &status, 0)) < 0 && errno == EINTR) {
+    }
+    if (waited < 0) {
+        //比如调用者忽略了SIGCHLD，Core已经被自动回收，不知道评测是否正常结束
+        int saved = errno;
+        munmap(p, sizeof(judge_result));
+        errno = saved;
+        return -1;
+    }
+    memcpy(result, shared, sizeof(judge_result));
+    munmap(p, sizeof(judge_result));
+    if (WIFEXITED(status)) {
+        result->exit_code = WEXITSTATUS(status);
+    } else {
+        result->exit_code = 128 + WTERMSIG(status);
+        result->result = JUDGE_CONF::SE;    //没来得及写结果，或者写到一半
+        strcpy(result->status, "System Error");
+    }
+    return 0;
+}
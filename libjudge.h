@@ -0,0 +1,69 @@
+#ifndef __LIBJUDGE__
+#define __LIBJUDGE__
+
+/*
+ * 评测库的C接口
+ *   g++ -shared -fPIC judge.cpp -o libjudge.so -O2
+ * Core命令行程序只是对judge_main的包装。
+ *
+ * 这只是命令行程序的进程级包装，不是改成返回错误码、没有全局状态的评测库，
+ * 也没有省掉每次评测的fork/exec：
+ * 评测的各个阶段（编译、沙盒、ptrace跟踪、比较）依赖进程级的状态：全局的题目参数、
+ * 信号处理、闹钟、rlimit、atexit、命名空间和CPU占用，出错时以exit()结束。
+ * 所以judge_run每次用posix_spawn启动一个新的Core进程评测，不在调用者fork出的进程里
+ * 运行评测代码，不会执行调用者的atexit回调和析构函数，多线程的调用者也可以同时调用。
+ * 结果通过memfd共享内存直接交回（fd号见JUDGE_RESULT_FD，环境变量LIBJUDGE_RESULT_FD），
+ * 不用再解析result.txt；result.txt照常写出。
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define JUDGE_MESSAGE_SIZE 4096
+
+struct judge_job {
+    const char *code_path;      //待评测的代码，同-c
+    const char *run_dir;        //运行目录，同-d
+    int time_limit;             //ms，同-t
+    int memory_limit;           //KB，同-m
+    int spj;                    //非0表示SpecialJudge，同-s
+    int spj_lang;               //同-S
+    int case_count;             //同-n
+    const char *const *options; //其余的命令行参数，以NULL结束，可以为NULL
+    const char *core_path;      //Core程序，为NULL时在PATH中找Core
+    const char *log_path;       //日志文件，同-l，为NULL时是运行目录下的core_log.txt
+};
+
+struct judge_result {
+    int result;         //JUDGE_CONF中的结果代码，如7为Accepted
+    int time_usage;     //ms
+    int memory_usage;   //KB
+    int exit_code;      //评测进程的退出码，同Core的退出码；被信号杀死时为128+信号
+    char status[32];    //结果名称，如"Accepted"
+    char extra_message[JUDGE_MESSAGE_SIZE];  //编译错误信息等，超出时截断
+};
+
+/*
+ * 用默认值填好job：时间1000ms，内存65536KB，一组数据
+ */
+void judge_job_init(struct judge_job *job);
+
+/*
+ * 启动一个Core进程评测一次并等待结束，结果写入result
+ * 返回0；无法开始评测（参数为空、找不到Core、无法创建共享内存）或等待Core失败时
+ * 返回-1并设置errno，此时result的内容无意义。
+ * 评测本身失败时返回0，result->result为System Error，exit_code说明原因
+ */
+int judge_run(const struct judge_job *job, struct judge_result *result);
+
+/*
+ * 在当前进程中评测，参数同Core，返回退出码；大多数错误直接exit()
+ */
+int judge_main(int argc, char *argv[]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
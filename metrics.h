@@ -0,0 +1,208 @@
+#ifndef __METRICS__
+#define __METRICS__
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <string>
+
+#include "core.h"
+#include "logger.h"
+
+/*
+ * 整台机器的评测统计，按Prometheus文本格式导出
+ *
+ * 所有Core进程映射同一个共享文件，记录时只做原子加，不加锁，可以放在热路径上。
+ * 每个Core进程退出时把当前的统计写成文本文件（先写临时文件再rename），
+ * 可以交给node_exporter的textfile collector采集
+ */
+const int METRIC_COMPILE = 0;
+const int METRIC_RUN     = 1;
+const int METRIC_COMPARE = 2;
+const int METRIC_SPJ     = 3;
+const int METRIC_PHASE_NUM = 4;
+static const char METRIC_PHASE_NAME[METRIC_PHASE_NUM][8] = {"compile", "run", "compare", "spj"};
+
+//直方图的上界(ms)，最后还有一个+Inf
+static const int METRIC_BUCKETS[] = {1, 5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 30000};
+const int METRIC_BUCKET_NUM = sizeof(METRIC_BUCKETS) / sizeof(METRIC_BUCKETS[0]);
+
+const unsigned long long METRICS_MAGIC = 0x4f4a4d4554524943ULL + METRIC_BUCKET_NUM;
+
+struct metric_histogram {
+    unsigned long long bucket[METRIC_BUCKET_NUM + 1];   //不累计，导出时再累加
+    unsigned long long sum_us;
+    unsigned long long count;
+};
+
+struct metrics_block {
+    unsigned long long magic;
+    metric_histogram latency[METRIC_PHASE_NUM];
+    unsigned long long verdict[16];       //按结果代号
+    unsigned long long exit_reason[128];  //按退出码
+    unsigned long long ptrace_stops;
+    unsigned long long cache_hits;        //评测结果缓存
+    unsigned long long cache_misses;
+    unsigned long long page_cache_hits;   //测试数据整个在页缓存中
+    unsigned long long page_cache_misses;
+};
+
+static metrics_block *metrics = NULL;
+
+bool metrics_init(const std::string &path) {
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    if (ftruncate(fd, sizeof(metrics_block)) < 0) {
+        close(fd);
+        return false;
+    }
+    void *p = mmap(NULL, sizeof(metrics_block), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    metrics = (metrics_block *)p;
+    //新文件或布局变了，从零开始
+    unsigned long long magic = __sync_val_compare_and_swap(&metrics->magic, 0, METRICS_MAGIC);
+    if (magic != 0 && magic != METRICS_MAGIC) {
+        FM_LOG_WARNING("metrics file %s has another layout, reset it", path.c_str());
+        memset((char *)metrics + sizeof(metrics->magic), 0, sizeof(metrics_block) - sizeof(metrics->magic));
+        metrics->magic = METRICS_MAGIC;
+    }
+    return true;
+}
+
+long long metrics_now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+void metrics_add(unsigned long long *counter, unsigned long long n) {
+    __sync_fetch_and_add(counter, n);
+}
+
+/*
+ * 记录某个阶段从start_us开始到现在的耗时
+ */
+void metrics_observe(int phase, long long start_us) {
+    if (metrics == NULL) {
+        return;
+    }
+    long long us = metrics_now_us() - start_us;
+    int i = 0;
+    while (i < METRIC_BUCKET_NUM && us > METRIC_BUCKETS[i] * 1000LL) {
+        i++;
+    }
+    metric_histogram &h = metrics->latency[phase];
+    metrics_add(&h.bucket[i], 1);
+    metrics_add(&h.sum_us, us);
+    metrics_add(&h.count, 1);
+}
+
+static const char *metrics_verdict_name(int result) {
+    static const char names[10][4] = {"OK", "CE", "TLE", "MLE", "OLE", "RE", "WA", "AC", "PE", "SE"};
+    return (result >= 0 && result < 10) ? names[result] : "UNKNOWN";
+}
+
+static const char *metrics_exit_name(int code) {
+    switch (code) {
+        case JUDGE_CONF::EXIT_OK:               return "EXIT_OK";
+        case JUDGE_CONF::EXIT_UNPRIVILEGED:     return "EXIT_UNPRIVILEGED";
+        case JUDGE_CONF::EXIT_BAD_PARAM:        return "EXIT_BAD_PARAM";
+        case JUDGE_CONF::EXIT_VERY_FIRST:       return "EXIT_VERY_FIRST";
+        case JUDGE_CONF::EXIT_COMPILE:          return "EXIT_COMPILE";
+        case JUDGE_CONF::EXIT_PRE_JUDGE:        return "EXIT_PRE_JUDGE";
+        case JUDGE_CONF::EXIT_PRE_JUDGE_PTRACE: return "EXIT_PRE_JUDGE_PTRACE";
+        case JUDGE_CONF::EXIT_PRE_JUDGE_EXECLP: return "EXIT_PRE_JUDGE_EXECLP";
+        case JUDGE_CONF::EXIT_SET_LIMIT:        return "EXIT_SET_LIMIT";
+        case JUDGE_CONF::EXIT_SET_SECURITY:     return "EXIT_SET_SECURITY";
+        case JUDGE_CONF::EXIT_JUDGE:            return "EXIT_JUDGE";
+        case JUDGE_CONF::EXIT_COMPARE:          return "EXIT_COMPARE";
+        case JUDGE_CONF::EXIT_COMPARE_SPJ:      return "EXIT_COMPARE_SPJ";
+        case JUDGE_CONF::EXIT_COMPARE_SPJ_FORK: return "EXIT_COMPARE_SPJ_FORK";
+        case JUDGE_CONF::EXIT_TIMEOUT:          return "EXIT_TIMEOUT";
+        case JUDGE_CONF::EXIT_BATCH_NEXT:       return "EXIT_BATCH_NEXT";
+        case JUDGE_CONF::EXIT_CPU_ALLOC:        return "EXIT_CPU_ALLOC";
+        case JUDGE_CONF::EXIT_PRESSURE:         return "EXIT_PRESSURE";
+        case JUDGE_CONF::EXIT_NS_POOL:          return "EXIT_NS_POOL";
+        case JUDGE_CONF::EXIT_UNKNOWN:          return "EXIT_UNKNOWN";
+        default:                                return NULL;
+    }
+}
+
+/*
+ * 写出Prometheus文本格式
+ */
+void metrics_export(const std::string &path) {
+    if (metrics == NULL) {
+        return;
+    }
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path.c_str(), (int)getpid());
+    FILE *fp = fopen(tmp, "w");
+    if (fp == NULL) {
+        return;
+    }
+
+    fprintf(fp, "# HELP oj_phase_duration_seconds Time spent in each judge phase.\n");
+    fprintf(fp, "# TYPE oj_phase_duration_seconds histogram\n");
+    for (int p = 0; p < METRIC_PHASE_NUM; p++) {
+        const metric_histogram &h = metrics->latency[p];
+        unsigned long long total = 0;
+        for (int i = 0; i <= METRIC_BUCKET_NUM; i++) {
+            total += h.bucket[i];
+            if (i < METRIC_BUCKET_NUM) {
+                fprintf(fp, "oj_phase_duration_seconds_bucket{phase=\"%s\",le=\"%g\"} %llu\n",
+                        METRIC_PHASE_NAME[p], METRIC_BUCKETS[i] / 1000.0, total);
+            } else {
+                fprintf(fp, "oj_phase_duration_seconds_bucket{phase=\"%s\",le=\"+Inf\"} %llu\n",
+                        METRIC_PHASE_NAME[p], total);
+            }
+        }
+        fprintf(fp, "oj_phase_duration_seconds_sum{phase=\"%s\"} %.6f\n", METRIC_PHASE_NAME[p], h.sum_us / 1e6);
+        fprintf(fp, "oj_phase_duration_seconds_count{phase=\"%s\"} %llu\n", METRIC_PHASE_NAME[p], h.count);
+    }
+
+    fprintf(fp, "# HELP oj_verdicts_total Final verdicts.\n");
+    fprintf(fp, "# TYPE oj_verdicts_total counter\n");
+    for (int i = JUDGE_CONF::CE; i <= JUDGE_CONF::SE; i++) {
+        fprintf(fp, "oj_verdicts_total{verdict=\"%s\"} %llu\n", metrics_verdict_name(i), metrics->verdict[i]);
+    }
+
+    fprintf(fp, "# HELP oj_exit_reasons_total Exit codes of judge processes.\n");
+    fprintf(fp, "# TYPE oj_exit_reasons_total counter\n");
+    for (int i = 0; i < 128; i++) {
+        const char *name = metrics_exit_name(i);
+        if (name != NULL || metrics->exit_reason[i] > 0) {
+            fprintf(fp, "oj_exit_reasons_total{reason=\"%s\",code=\"%d\"} %llu\n",
+                    name ? name : "OTHER", i, metrics->exit_reason[i]);
+        }
+    }
+
+    fprintf(fp, "# HELP oj_ptrace_stops_total Syscall stops handled by the tracer.\n");
+    fprintf(fp, "# TYPE oj_ptrace_stops_total counter\n");
+    fprintf(fp, "oj_ptrace_stops_total %llu\n", metrics->ptrace_stops);
+    fprintf(fp, "# HELP oj_verdict_cache_total Verdict cache lookups.\n");
+    fprintf(fp, "# TYPE oj_verdict_cache_total counter\n");
+    fprintf(fp, "oj_verdict_cache_total{result=\"hit\"} %llu\n", metrics->cache_hits);
+    fprintf(fp, "oj_verdict_cache_total{result=\"miss\"} %llu\n", metrics->cache_misses);
+    fprintf(fp, "# HELP oj_page_cache_total Test data files found fully in the page cache.\n");
+    fprintf(fp, "# TYPE oj_page_cache_total counter\n");
+    fprintf(fp, "oj_page_cache_total{result=\"hit\"} %llu\n", metrics->page_cache_hits);
+    fprintf(fp, "oj_page_cache_total{result=\"miss\"} %llu\n", metrics->page_cache_misses);
+    fclose(fp);
+
+    if (rename(tmp, path.c_str()) < 0) {
+        unlink(tmp);
+    }
+}
+
+#endif
@@ -0,0 +1,276 @@
+#ifndef __NS_POOL__
+#define __NS_POOL__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+
+#include <string>
+#include <vector>
+
+#include "logger.h"
+
+/*
+ * 非特权沙盒用的命名空间池
+ * 不用root时，隔离靠用户、挂载、PID三个命名空间：在用户命名空间里可以chroot，
+ * 用户程序以命名空间里的nobody运行，exec之后没有任何权限；PID命名空间里看不到外面的进程。
+ *
+ * 创建命名空间（尤其是PID命名空间的init进程）比较慢，所以由常驻的管理进程预先建好若干组，
+ * 每组的init进程的pid写在池目录下的slot<N>.pid中。Core用flock占用slot<N>.lock，
+ * 然后setns加入这一组的三个命名空间，之后fork出的编译器、用户程序都在里面；
+ * 占用和退出时各清空一次这组PID命名空间里残留的进程，进程崩溃时锁由内核自动释放。
+ *
+ * 管理进程和Core必须以同一个非root用户运行：命名空间里的nobody就映射成这个用户
+ */
+static std::string ns_pool_dir;
+static int ns_pool_lock_fd = -1;
+static pid_t ns_pool_owner = -1;
+
+static
+std::string ns_pool_file(int slot, const char *suffix) {
+    char name[64];
+    snprintf(name, sizeof(name), "/slot%d.%s", slot, suffix);
+    return ns_pool_dir + name;
+}
+
+static
+bool ns_pool_write(const char *path, const char *content) {
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    ssize_t len = strlen(content);
+    bool ok = write(fd, content, len) == len;
+    close(fd);
+    return ok;
+}
+
+/*
+ * PID命名空间的init：只负责回收孤儿进程
+ */
+static
+void ns_pool_init() {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &set, NULL);
+    while (true) {
+        while (waitpid(-1, NULL, WNOHANG | __WALL) > 0) {
+        }
+        sigwaitinfo(&set, NULL);
+    }
+}
+
+/*
+ * 建立第slot组命名空间，在子进程中运行，直到这组的init退出
+ */
+static
+void ns_pool_holder(int slot, uid_t uid, gid_t gid) {
+    uid_t outer_uid = geteuid();
+    gid_t outer_gid = getegid();
+    if (unshare(CLONE_NEWUSER | CLONE_NEWNS | CLONE_NEWPID) < 0) {
+        FM_LOG_WARNING("unshare for slot %d failed, %d: %s", slot, errno, strerror(errno));
+        _exit(EXIT_FAILURE);
+    }
+    char map[64];
+    snprintf(map, sizeof(map), "%d %d 1\n", (int)uid, (int)outer_uid);
+    bool mapped = ns_pool_write("/proc/self/uid_map", map);
+    snprintf(map, sizeof(map), "%d %d 1\n", (int)gid, (int)outer_gid);
+    mapped = mapped && ns_pool_write("/proc/self/setgroups", "deny") &&
+             ns_pool_write("/proc/self/gid_map", map);
+    //沙盒里的挂载不能传播出去
+    if (!mapped || mount(NULL, "/", NULL, MS_REC | MS_PRIVATE, NULL) < 0) {
+        FM_LOG_WARNING("setup namespaces for slot %d failed, %d: %s", slot, errno, strerror(errno));
+        _exit(EXIT_FAILURE);
+    }
+
+    pid_t init = fork();
+    if (init < 0) {
+        _exit(EXIT_FAILURE);
+    } else if (init == 0) {
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        ns_pool_init();
+    }
+
+    //先写临时文件再rename，Core不会读到一半
+    std::string path = ns_pool_file(slot, "pid");
+    std::string tmp = path + ".tmp";
+    FILE *fp = fopen(tmp.c_str(), "w");
+    if (fp == NULL || fprintf(fp, "%d\n", (int)init) < 0 || fclose(fp) != 0 ||
+        rename(tmp.c_str(), path.c_str()) < 0) {
+        FM_LOG_WARNING("write %s failed, %d: %s", path.c_str(), errno, strerror(errno));
+        kill(init, SIGKILL);
+        _exit(EXIT_FAILURE);
+    }
+    waitpid(init, NULL, 0);
+    _exit(EXIT_SUCCESS);
+}
+
+/*
+ * 作为池的管理进程运行，保持size组命名空间，某组的init退出后重新建立，不会返回
+ */
+void ns_pool_manager(const std::string &dir, int size, uid_t uid, gid_t gid) {
+    ns_pool_dir = dir;
+    std::vector<pid_t> holders(size, 0);   //0表示待建立
+    FM_LOG_NOTICE("namespace pool started, %d slots in %s", size, dir.c_str());
+
+    while (true) {
+        for (int slot = 0; slot < size; slot++) {
+            if (holders[slot] > 0) continue;
+            holders[slot] = fork();
+            if (holders[slot] == 0) {
+                ns_pool_holder(slot, uid, gid);
+            } else if (holders[slot] < 0) {
+                FM_LOG_WARNING("fork holder for slot %d failed, %d: %s", slot, errno, strerror(errno));
+            }
+        }
+
+        pid_t dead = waitpid(-1, NULL, 0);
+        for (int slot = 0; slot < size; slot++) {
+            if (dead > 0 && holders[slot] == dead) {
+                FM_LOG_WARNING("namespace slot %d is gone, rebuild it", slot);
+                holders[slot] = 0;
+            }
+        }
+        sleep(1);   //一直建立失败时不要空转
+    }
+}
+
+/*
+ * 清空当前这组PID命名空间里残留的进程
+ * fork出的子进程在命名空间里，kill(-1)只作用于同一命名空间中除init和自己以外的进程
+ */
+void ns_pool_reset() {
+    if (ns_pool_lock_fd < 0 || getpid() != ns_pool_owner) {
+        return;
+    }
+    pid_t cleaner = fork();
+    if (cleaner == 0) {
+        kill(-1, SIGKILL);
+        _exit(EXIT_SUCCESS);
+    }
+    if (cleaner > 0) {
+        waitpid(cleaner, NULL, 0);
+    }
+}
+
+/*
+ * 加入某组的三个命名空间，成功返回true
+ */
+static
+bool ns_pool_join(int slot) {
+    FILE *fp = fopen(ns_pool_file(slot, "pid").c_str(), "r");
+    int init = 0;
+    if (fp == NULL) {
+        return false;
+    }
+    if (1 != fscanf(fp, "%d", &init)) {
+        init = 0;
+    }
+    fclose(fp);
+    if (init <= 0) {
+        return false;
+    }
+
+    const char *names[] = {"user", "mnt", "pid"};
+    const int types[] = {CLONE_NEWUSER, CLONE_NEWNS, CLONE_NEWPID};
+    int fds[3];
+    for (int i = 0; i < 3; i++) {
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%d/ns/%s", init, names[i]);
+        fds[i] = open(path, O_RDONLY | O_CLOEXEC);
+    }
+    //init已经退出、pid被别的进程重用时，其命名空间和自己的相同
+    struct stat ours, theirs;
+    bool ok = fds[0] >= 0 && fds[1] >= 0 && fds[2] >= 0 &&
+              stat("/proc/self/ns/user", &ours) == 0 && fstat(fds[0], &theirs) == 0 &&
+              ours.st_ino != theirs.st_ino;
+    for (int i = 0; i < 3 && ok; i++) {
+        if (setns(fds[i], types[i]) < 0) {
+            FM_LOG_WARNING("setns(%s) for slot %d failed, %d: %s", names[i], slot, errno, strerror(errno));
+            ok = false;
+        }
+    }
+    for (int i = 0; i < 3; i++) {
+        if (fds[i] >= 0) close(fds[i]);
+    }
+    return ok;
+}
+
+/*
+ * 占用一组空闲的命名空间并加入，wait_ms毫秒内没有等到则返回false
+ * 必须在单线程、还没有fork任何子进程时调用
+ */
+bool ns_pool_enter(const std::string &dir, int wait_ms) {
+    ns_pool_dir = dir;
+    char cwd[4096];
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+        return false;
+    }
+
+    for (int waited = 0; waited <= wait_ms; waited++) {
+        for (int slot = 0; access(ns_pool_file(slot, "pid").c_str(), F_OK) == 0; slot++) {
+            int fd = open(ns_pool_file(slot, "lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+            if (fd < 0 || flock(fd, LOCK_EX | LOCK_NB) < 0) {
+                if (fd >= 0) close(fd);
+                continue;
+            }
+            if (!ns_pool_join(slot)) {
+                close(fd);  //这组坏了（比如正在重建），试下一组
+                continue;
+            }
+            //加入挂载命名空间后根目录和当前目录都变成了命名空间的根
+            if (chdir(cwd) < 0) {
+                FM_LOG_WARNING("chdir(%s) in slot %d failed, %d: %s", cwd, slot, errno, strerror(errno));
+                close(fd);
+                return false;
+            }
+            ns_pool_lock_fd = fd;
+            ns_pool_owner = getpid();
+            FM_LOG_TRACE("Joined namespace slot %d", slot);
+            ns_pool_reset();    //上一个使用者可能崩溃了，没来得及清理
+            return true;
+        }
+        usleep(1000);
+    }
+    FM_LOG_WARNING("no free namespace slot in %d ms", wait_ms);
+    return false;
+}
+
+bool ns_pool_active() {
+    return ns_pool_lock_fd >= 0;
+}
+
+/*
+ * 用户程序进程在chroot之前调用：在自己的挂载命名空间里把沙盒目录重新挂成只读，
+ * 沙盒目录属于运行Core的用户，不这样做用户程序（映射成同一个用户）就能改写测试数据。
+ * 挂载命名空间随进程退出消失，池里的这组命名空间保持原样
+ */
+bool ns_pool_seal(const std::string &dir) {
+    //原挂载上的noexec在用户命名空间里是锁定的，重新挂载时必须带上
+    struct statvfs vfs;
+    unsigned long flags = MS_BIND | MS_REMOUNT | MS_RDONLY | MS_NOSUID | MS_NODEV;
+    if (statvfs(dir.c_str(), &vfs) == 0 && (vfs.f_flag & ST_NOEXEC)) {
+        flags |= MS_NOEXEC;
+    }
+    if (unshare(CLONE_NEWNS) < 0 ||
+        mount(dir.c_str(), dir.c_str(), NULL, MS_BIND, NULL) < 0 ||
+        mount(NULL, dir.c_str(), NULL, flags, NULL) < 0) {
+        FM_LOG_WARNING("seal %s failed, %d: %s", dir.c_str(), errno, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+#endif
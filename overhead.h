@@ -0,0 +1,148 @@
+#ifndef __OVERHEAD__
+#define __OVERHEAD__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/ptrace.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include <string>
+
+#include "logger.h"
+
+/*
+ * ptrace停顿开销的校准
+ * 用户程序每次在系统调用出入口停下，内核要走慢速路径、切换上下文，这部分时间记在用户程序的
+ * CPU时间里。系统调用多的程序因此多算了时间，这部分其实是评测机自己的开销。
+ *
+ * 校准时让同一个小程序做固定次数的系统调用，分别在跟踪和不跟踪的情况下运行，
+ * 两者CPU时间之差除以停顿次数就是每次停顿多算的时间。
+ * 结果缓存在文件里供其他Core进程读取和事后核对，有效期内不再重测
+ */
+const int OVERHEAD_CALLS  = 20000;  //每次测量做的系统调用次数，跟踪时停顿两倍这么多次
+const int OVERHEAD_ROUNDS = 3;      //测几次取开销最小的一次
+
+struct overhead_sample {
+    double ns_per_stop;     //每次停顿多算的CPU时间
+    double traced_ms;       //跟踪时小程序的CPU时间
+    double plain_ms;        //不跟踪时小程序的CPU时间
+    long long stops;
+};
+
+/*
+ * 运行一次小程序，返回其CPU时间(ns)，失败返回-1
+ */
+static
+long long overhead_child_cpu(bool traced, long long &stops) {
+    stops = 0;
+    pid_t child = fork();
+    if (child < 0) {
+        return -1;
+    } else if (child == 0) {
+        if (traced) {
+            if (ptrace(PTRACE_TRACEME, 0, NULL, NULL) < 0) {
+                _exit(EXIT_FAILURE);
+            }
+            raise(SIGSTOP); //等父进程开始跟踪系统调用
+        }
+        for (int i = 0; i < OVERHEAD_CALLS; i++) {
+            syscall(SYS_getppid);
+        }
+        _exit(EXIT_SUCCESS);
+    }
+
+    int status = 0;
+    struct rusage rused;
+    while (true) {
+        if (wait4(child, &status, 0, &rused) < 0) {
+            kill(child, SIGKILL);
+            waitpid(child, NULL, 0);
+            return -1;
+        }
+        if (!WIFSTOPPED(status)) {
+            break;
+        }
+        stops++;
+        if (ptrace(PTRACE_SYSCALL, child, NULL, NULL) < 0) {
+            kill(child, SIGKILL);
+            waitpid(child, NULL, 0);
+            return -1;
+        }
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+        return -1;
+    }
+    return (rused.ru_utime.tv_sec + rused.ru_stime.tv_sec) * 1000000000LL +
+           (rused.ru_utime.tv_usec + rused.ru_stime.tv_usec) * 1000LL;
+}
+
+static
+bool overhead_measure(overhead_sample &sample) {
+    bool ok = false;
+    for (int round = 0; round < OVERHEAD_ROUNDS; round++) {
+        long long stops, unused;
+        long long traced = overhead_child_cpu(true, stops);
+        long long plain = overhead_child_cpu(false, unused);
+        if (traced < 0 || plain < 0 || stops == 0) {
+            continue;
+        }
+        double cost = traced > plain ? (double)(traced - plain) / stops : 0;
+        if (!ok || cost < sample.ns_per_stop) {
+            sample.ns_per_stop = cost;
+            sample.traced_ms = traced / 1e6;
+            sample.plain_ms = plain / 1e6;
+            sample.stops = stops;
+            ok = true;
+        }
+    }
+    if (ok) {
+        FM_LOG_TRACE("ptrace stop costs %.0f ns: traced %.3f ms, plain %.3f ms, %lld stops",
+                sample.ns_per_stop, sample.traced_ms, sample.plain_ms, sample.stops);
+    }
+    return ok;
+}
+
+/*
+ * 取这台机器的每次停顿开销，缓存过期或不存在时重新测
+ * 缓存文件一行：每次停顿(ns) 跟踪时(ms) 不跟踪时(ms) 停顿次数 测量时间
+ */
+bool overhead_calibrate(const std::string &path, int ttl, overhead_sample &sample) {
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    if (flock(fd, LOCK_EX) < 0) {
+        close(fd);
+        return false;
+    }
+
+    char line[256] = {0};
+    ssize_t len = pread(fd, line, sizeof(line) - 1, 0);
+    long long stamp = 0;
+    bool cached = len > 0 &&
+        5 == sscanf(line, "%lf %lf %lf %lld %lld", &sample.ns_per_stop, &sample.traced_ms,
+                    &sample.plain_ms, &sample.stops, &stamp) &&
+        time(NULL) - stamp < ttl;
+
+    bool ok = cached;
+    if (!cached && (ok = overhead_measure(sample))) {
+        len = snprintf(line, sizeof(line), "%.1f %.3f %.3f %lld %lld\n", sample.ns_per_stop,
+                sample.traced_ms, sample.plain_ms, sample.stops, (long long)time(NULL));
+        if (ftruncate(fd, 0) < 0 || pwrite(fd, line, len, 0) != len) {
+            FM_LOG_WARNING("write overhead %s failed, %d: %s", path.c_str(), errno, strerror(errno));
+        }
+    }
+    close(fd);  //同时释放flock
+    return ok;
+}
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef __PERF_PROFILE__
+#define __PERF_PROFILE__
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "logger.h"
+
+/*
+ * 用perf_event_open直接统计用户程序的硬件计数器，不依赖perf工具
+ * 计数器在judge()第一次停下（execve之后）时挂到子进程上，
+ * 所以只统计用户程序本身，不包括沙盒的准备过程
+ *
+ * 所有计数器放在同一组里，保证同时调度；
+ * 虚拟机里常常没有硬件计数器，打不开的计数器记为不可用，其余的照常统计
+ */
+struct perf_counter {
+    const char *name;
+    __u32 type;
+    __u64 config;
+};
+
+#define PERF_CACHE_MISS(cache) \
+    ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const perf_counter PERF_COUNTERS[] =
+{
+    {"cycles",        PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions",  PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"l1d_misses",    PERF_TYPE_HW_CACHE, PERF_CACHE_MISS(PERF_COUNT_HW_CACHE_L1D)},
+    {"llc_misses",    PERF_TYPE_HW_CACHE, PERF_CACHE_MISS(PERF_COUNT_HW_CACHE_LL)},
+    {"branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {"page_faults",   PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+};
+const int PERF_COUNTER_NUM = sizeof(PERF_COUNTERS) / sizeof(PERF_COUNTERS[0]);
+
+static int perf_fd[PERF_COUNTER_NUM];
+//累计值，多组测试数据时各组相加；-1表示不可用
+static long long perf_total[PERF_COUNTER_NUM];
+static bool perf_total_inited = false;
+
+static
+int perf_event_open(perf_event_attr *attr, pid_t pid, int cpu, int group_fd, unsigned long flags) {
+    return syscall(__NR_perf_event_open, attr, pid, cpu, group_fd, flags);
+}
+
+/*
+ * 在子进程上打开计数器，打开即开始计数
+ */
+void perf_profile_open(pid_t pid) {
+    if (!perf_total_inited) {
+        memset(perf_total, 0, sizeof(perf_total));
+        perf_total_inited = true;
+    }
+
+    int leader = -1;
+    for (int i = 0; i < PERF_COUNTER_NUM; i++) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_COUNTERS[i].type;
+        attr.config = PERF_COUNTERS[i].config;
+        attr.disabled = (leader == -1);
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        perf_fd[i] = perf_event_open(&attr, pid, -1, leader, PERF_FLAG_FD_CLOEXEC);
+        if (perf_fd[i] < 0) {
+            FM_LOG_NOTICE("perf counter %s unavailable, %d: %s", PERF_COUNTERS[i].name, errno, strerror(errno));
+            perf_total[i] = -1;
+        } else if (leader == -1) {
+            leader = perf_fd[i];
+        }
+    }
+
+    if (leader != -1) {
+        ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+}
+
+/*
+ * 读出计数器并关闭，计数器被复用时按运行时间比例放大
+ */
+void perf_profile_close() {
+    for (int i = 0; i < PERF_COUNTER_NUM; i++) {
+        if (perf_fd[i] < 0) continue;
+        unsigned long long data[3];    //value, time_enabled, time_running
+        if (read(perf_fd[i], data, sizeof(data)) == sizeof(data) && perf_total[i] >= 0) {
+            if (data[2] > 0 && data[2] < data[1]) {
+                data[0] = (unsigned long long)((double)data[0] * data[1] / data[2]);
+            }
+            perf_total[i] += data[0];
+        }
+        close(perf_fd[i]);
+        perf_fd[i] = -1;
+    }
+}
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef __PRESSURE__
+#define __PRESSURE__
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "logger.h"
+
+/*
+ * 基于PSI（/proc/pressure下的cpu、memory、io）的准入控制
+ * 机器压力大时测出来的时间会偏大，所以在开始运行前等待压力降下来，
+ * 超过等待上限仍然降不下来就放弃，由调度方重新排队
+ *
+ * 取的是各资源"some"一行的avg10，即最近10秒内有任务因该资源停顿的时间百分比
+ */
+const int PRESSURE_CPU    = 0;
+const int PRESSURE_MEMORY = 1;
+const int PRESSURE_IO     = 2;
+const int PRESSURE_NUM    = 3;
+static const char PRESSURE_NAME[PRESSURE_NUM][8] = {"cpu", "memory", "io"};
+
+struct pressure_policy {
+    double limit[PRESSURE_NUM];  //各资源avg10的上限(%)
+    int wait_ms;                 //最多等待多久
+};
+
+/*
+ * 读取各资源的some avg10，读不到（内核没有开PSI）记为0
+ */
+static
+void read_pressure(double value[PRESSURE_NUM]) {
+    for (int i = 0; i < PRESSURE_NUM; i++) {
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/pressure/%s", PRESSURE_NAME[i]);
+        value[i] = 0;
+        FILE *fp = fopen(path, "r");
+        if (fp == NULL) continue;
+        if (1 != fscanf(fp, "some avg10=%lf", &value[i])) {
+            value[i] = 0;
+        }
+        fclose(fp);
+    }
+}
+
+/*
+ * 等待压力降到上限以下
+ * 返回是否准入，value中是最后一次观察到的压力，waited_ms是等待的时间
+ */
+bool pressure_admit(const pressure_policy &policy, double value[PRESSURE_NUM], int &waited_ms) {
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    waited_ms = 0;
+    while (true) {
+        read_pressure(value);
+        bool ok = true;
+        for (int i = 0; i < PRESSURE_NUM; i++) {
+            ok &= value[i] <= policy.limit[i];
+        }
+        if (ok) return true;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        waited_ms = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
+        if (waited_ms >= policy.wait_ms) {
+            FM_LOG_WARNING("pressure stays high: cpu %.2f memory %.2f io %.2f",
+                    value[PRESSURE_CPU], value[PRESSURE_MEMORY], value[PRESSURE_IO]);
+            return false;
+        }
+        usleep(100000); //avg10本身变化不快，没必要查得太勤
+    }
+}
+
+#endif
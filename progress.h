@@ -0,0 +1,221 @@
+#ifndef __PROGRESS__
+#define __PROGRESS__
+
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <string>
+
+/*
+ * 评测进度的实时发布
+ * 运行目录下的progress文件映射成共享内存，评测进程边评测边更新其中的状态记录，
+ * 前端映射同一个文件直接读，不必等result.txt出现，也不必轮询文件。
+ *
+ * 记录用顺序锁保护：写之前把seq加到奇数，写完再加到偶数；读者先读seq，
+ * 复制整个记录，再读一次seq，两次相同且为偶数时复制的内容就是一致的。
+ * 写一次只是几次内存写，不产生系统调用（时间由vDSO读取）。
+ * 当前这组的用量在每次ptrace停顿时更新，不停下的程序由定时器每PROGRESS_INTERVAL毫秒从/proc更新。
+ * 只有评测进程写，批量评测时同一个提交的各阶段进程依次接着写。
+ */
+const unsigned int PROGRESS_MAGIC = 0x4f4a5052;
+const int PROGRESS_CASES = 1024;    //超过的组不记录各自的结果
+const int PROGRESS_READ_RETRIES = 100000;   //读者等写者写完的次数上限，写者中途消失时不会一直等
+
+//阶段
+const int PROGRESS_START   = 0;
+const int PROGRESS_COMPILE = 1;
+const int PROGRESS_RUN     = 2;
+const int PROGRESS_COMPARE = 3;
+const int PROGRESS_DONE    = 4;
+
+//各组的结果，其余取值同JUDGE_CONF中的结果代码
+const signed char PROGRESS_PENDING = 0;
+const signed char PROGRESS_SKIPPED = -1;
+
+struct progress_record {
+    unsigned int magic;
+    unsigned int seq;       //奇数表示正在写
+    int pid;                //评测进程，批量评测时是调度进程，读者据此判断评测是否还在进行
+    int phase;
+    int case_count;
+    int current_case;       //从1开始，0表示还没有开始运行
+    int time_usage;         //当前这组到目前为止的CPU时间(ms)
+    int memory_usage;       //当前这组到目前为止的内存峰值(KB)
+    int result;             //最终结果，PROGRESS_DONE时有效
+    int reserved;
+    long long updated_us;   //CLOCK_MONOTONIC，微秒
+    signed char verdicts[PROGRESS_CASES];
+};
+
+static progress_record *progress = NULL;
+
+/*
+ * 映射进度文件，reset为true或者文件中没有有效记录时重新开始
+ */
+bool progress_init(const std::string &path, bool reset, pid_t owner) {
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    if (ftruncate(fd, sizeof(progress_record)) < 0) {
+        close(fd);
+        return false;
+    }
+    void *p = mmap(NULL, sizeof(progress_record), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    progress = (progress_record *)p;
+    if (reset || progress->magic != PROGRESS_MAGIC) {
+        memset(progress, 0, sizeof(progress_record));
+        progress->magic = PROGRESS_MAGIC;
+    }
+    progress->pid = owner;
+    return true;
+}
+
+static void progress_write_begin() {
+    progress->seq++;
+    __sync_synchronize();
+}
+
+static void progress_write_end() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    progress->updated_us = ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+    __sync_synchronize();
+    progress->seq++;
+}
+
+void progress_phase(int phase) {
+    if (progress == NULL) return;
+    progress_write_begin();
+    progress->phase = phase;
+    progress_write_end();
+}
+
+/*
+ * 开始运行，共n组，各组结果清空
+ */
+void progress_cases(int n) {
+    if (progress == NULL) return;
+    progress_write_begin();
+    progress->phase = PROGRESS_RUN;
+    progress->case_count = n;
+    progress->current_case = 0;
+    memset(progress->verdicts, PROGRESS_PENDING, sizeof(progress->verdicts));
+    progress_write_end();
+}
+
+/*
+ * 开始第i组（从0开始）
+ */
+void progress_case(int i, int phase) {
+    if (progress == NULL) return;
+    progress_write_begin();
+    progress->phase = phase;
+    progress->current_case = i + 1;
+    progress->time_usage = 0;
+    progress->memory_usage = 0;
+    progress_write_end();
+}
+
+/*
+ * 当前这组的资源使用，评测进程每次ptrace停顿时调用
+ */
+void progress_usage(int time_usage, int memory_usage) {
+    if (progress == NULL) return;
+    progress_write_begin();
+    progress->time_usage = time_usage;
+    progress->memory_usage = memory_usage;
+    progress_write_end();
+}
+
+void progress_verdict(int i, int result) {
+    if (progress == NULL || i < 0 || i >= PROGRESS_CASES) return;
+    progress_write_begin();
+    progress->verdicts[i] = result;
+    progress_write_end();
+}
+
+void progress_done(int result, int time_usage, int memory_usage) {
+    if (progress == NULL) return;
+    progress_write_begin();
+    progress->phase = PROGRESS_DONE;
+    progress->result = result;
+    progress->time_usage = time_usage;
+    progress->memory_usage = memory_usage;
+    progress_write_end();
+}
+
+static void progress_tick(int /*signo*/) {
+    //只是为了打断阻塞的wait4
+}
+
+/*
+ * 跟踪进程平时阻塞在wait4里，CPU密集、不做系统调用的程序不会停下，
+ * 所以每interval_ms毫秒用SIGUSR2打断一次wait4，由调用者从/proc刷新用量
+ */
+bool progress_timer_start(int interval_ms, timer_t &timer, struct sigaction &old) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = progress_tick;  //不带SA_RESTART，wait4返回EINTR
+    sigaction(SIGUSR2, &sa, &old);
+
+    struct sigevent sev;
+    memset(&sev, 0, sizeof(sev));
+    sev.sigev_notify = SIGEV_SIGNAL;
+    sev.sigev_signo = SIGUSR2;
+    if (timer_create(CLOCK_MONOTONIC, &sev, &timer) < 0) {
+        sigaction(SIGUSR2, &old, NULL);
+        return false;
+    }
+    struct itimerspec its;
+    its.it_value.tv_sec = its.it_interval.tv_sec = interval_ms / 1000;
+    its.it_value.tv_nsec = its.it_interval.tv_nsec = interval_ms % 1000 * 1000000L;
+    timer_settime(timer, 0, &its, NULL);
+    return true;
+}
+
+/*
+ * 停止定时器，丢掉还没处理的SIGUSR2再恢复原来的处理方式，之后的系统调用不会再被打断
+ */
+void progress_timer_stop(timer_t timer, const struct sigaction &old) {
+    timer_delete(timer);
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR2);
+    sigprocmask(SIG_BLOCK, &set, NULL);
+    struct timespec zero = {0, 0};
+    while (sigtimedwait(&set, NULL, &zero) > 0) {
+    }
+    sigaction(SIGUSR2, &old, NULL);
+    sigprocmask(SIG_UNBLOCK, &set, NULL);
+}
+
+/*
+ * 读者用：读出一致的一份记录，写者正在写时重试
+ * 重试PROGRESS_READ_RETRIES次仍然没有读到（写者写到一半时退出了）返回false，out是过时的
+ */
+bool progress_read(const volatile progress_record *p, progress_record &out) {
+    for (int i = 0; i < PROGRESS_READ_RETRIES; i++) {
+        unsigned int seq = p->seq;
+        __sync_synchronize();
+        if (seq & 1) {
+            continue;
+        }
+        memcpy(&out, (const void *)p, sizeof(progress_record));
+        __sync_synchronize();
+        if (p->seq == seq) {
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif
@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "progress.h"
+
+/*
+ * 读评测进度的参考实现
+ *   ProgressReader -d 运行目录 [-w]
+ * 不加-w时输出当前状态一次；加上-w时每当状态变化就输出一行，评测结束后退出。
+ * 评测进程没有写完就消失时（比如被杀掉）退出码为1
+ */
+static const char *PHASES[] = {"start", "compile", "run", "compare", "done"};
+
+static const char *RESULTS[] = {"-", "CE", "TLE", "MLE", "OLE", "RE", "WA", "AC", "PE", "SE"};
+
+static
+const char *verdict_name(int result) {
+    if (result == PROGRESS_SKIPPED) return "skip";
+    if (result < 0 || result >= (int)(sizeof(RESULTS) / sizeof(RESULTS[0]))) return "?";
+    return RESULTS[result];
+}
+
+static
+void print_record(const progress_record &r) {
+    printf("%s", r.phase >= 0 && r.phase <= PROGRESS_DONE ? PHASES[r.phase] : "?");
+    if (r.phase == PROGRESS_DONE) {
+        printf(" result %s", verdict_name(r.result));
+    } else if (r.current_case > 0) {
+        printf(" case %d/%d", r.current_case, r.case_count);
+    }
+    printf(" time %d memory %d", r.time_usage, r.memory_usage);
+    if (r.case_count > 0) {
+        printf(" cases");
+        for (int i = 0; i < r.case_count && i < PROGRESS_CASES; i++) {
+            printf(" %s", verdict_name(r.verdicts[i]));
+        }
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+    std::string run_dir;
+    bool watch = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "d:w")) != -1) {
+        switch (opt) {
+            case 'd': run_dir = optarg; break;
+            case 'w': watch = true;     break;
+            default:
+                fprintf(stderr, "usage: %s -d run_dir [-w]\n", argv[0]);
+                return 2;
+        }
+    }
+    if (run_dir.empty()) {
+        fprintf(stderr, "usage: %s -d run_dir [-w]\n", argv[0]);
+        return 2;
+    }
+
+    std::string path = run_dir + "/progress";
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "open %s failed: %s\n", path.c_str(), strerror(errno));
+        return 2;
+    }
+    void *p = mmap(NULL, sizeof(progress_record), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        fprintf(stderr, "mmap %s failed: %s\n", path.c_str(), strerror(errno));
+        return 2;
+    }
+    const volatile progress_record *shared = (const volatile progress_record *)p;
+
+    static progress_record r;
+    if (!progress_read(shared, r)) {
+        fprintf(stderr, "%s is stale, the judge stopped while writing it\n", path.c_str());
+        return 1;
+    }
+    if (r.magic != PROGRESS_MAGIC) {
+        fprintf(stderr, "%s is not a progress record\n", path.c_str());
+        return 2;
+    }
+    print_record(r);
+
+    unsigned int seen = r.seq;
+    struct timespec interval = {0, 1000000};
+    while (watch && r.phase != PROGRESS_DONE) {
+        nanosleep(&interval, NULL);
+        if (shared->seq == seen) {
+            //先确认进程不在了，再确认它退出前没有写过
+            if (kill(r.pid, 0) < 0 && errno == ESRCH && shared->seq == seen) {
+                fprintf(stderr, "judge process %d is gone\n", r.pid);
+                return 1;
+            }
+            continue;
+        }
+        static progress_record next;
+        if (!progress_read(shared, next)) {
+            //写到一半：进程还在时只是碰巧一直没读到，下次再读
+            if (kill(r.pid, 0) < 0 && errno == ESRCH) {
+                fprintf(stderr, "judge process %d is gone, %s is stale\n", r.pid, path.c_str());
+                return 1;
+            }
+            continue;
+        }
+        r = next;
+        seen = r.seq;
+        print_record(r);
+    }
+    return 0;
+}
@@ -0,0 +1,321 @@
+#ifndef __RESIDENCY__
+#define __RESIDENCY__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#include "logger.h"
+
+/*
+ * 热门测试数据的页缓存常驻管理
+ *
+ * 评测时（-H）：检查每个数据文件是否整个在页缓存里，累计命中/未命中次数，
+ *     并把文件路径追加到访问日志
+ * 管理进程（-K 预算MB）：定期读走访问日志，按衰减后的访问频率从高到低挑选文件，
+ *     在内存预算内mmap + mlock，让它们不会被内存压力挤出页缓存；
+ *     -W 给出的题目目录在比赛开始前预热，初始频率很高
+ *
+ * 状态目录下：
+ *   access.log  评测进程追加的访问记录，每行一个路径
+ *   counters    命中/未命中计数，两个64位整数，mmap后原子加
+ *   status      管理进程定期写出的当前常驻文件和计数
+ */
+const double RESIDENCY_DECAY = 0.5;     //每轮频率衰减的比例
+const double RESIDENCY_WARM_FREQ = 1e9; //预热文件的初始频率
+const double RESIDENCY_MIN_FREQ = 0.01; //频率低于此值的文件不再记录
+
+struct residency_counters {
+    unsigned long long hits;
+    unsigned long long misses;
+};
+
+static std::string residency_dir;
+
+bool residency_init(const std::string &dir) {
+    residency_dir = dir;
+    for (size_t i = 1; i <= dir.size(); i++) {
+        if (i == dir.size() || dir[i] == '/') {
+            if (mkdir(dir.substr(0, i).c_str(), 0755) < 0 && errno != EEXIST) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static
+residency_counters *residency_map_counters() {
+    std::string path = residency_dir + "/counters";
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (ftruncate(fd, sizeof(residency_counters)) < 0) {
+        close(fd);
+        return NULL;
+    }
+    void *p = mmap(NULL, sizeof(residency_counters), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return p == MAP_FAILED ? NULL : (residency_counters *)p;
+}
+
+/*
+ * 文件是否整个在页缓存中
+ */
+static
+bool file_resident(const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    bool resident = true;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+            resident = false;
+        } else {
+            size_t pages = (st.st_size + getpagesize() - 1) / getpagesize();
+            std::vector<unsigned char> vec(pages);
+            if (mincore(p, st.st_size, &vec[0]) < 0) {
+                resident = false;
+            }
+            for (size_t i = 0; resident && i < pages; i++) {
+                resident = vec[i] & 1;
+            }
+            munmap(p, st.st_size);
+        }
+    }
+    close(fd);
+    return resident;
+}
+
+/*
+ * 评测进程记录一次数据文件访问，返回文件是否整个在页缓存中
+ */
+bool residency_touch(const std::string &path) {
+    char real[PATH_MAX];
+    if (realpath(path.c_str(), real) == NULL) {
+        return false;
+    }
+
+    static residency_counters *counters = residency_map_counters();
+    bool hit = file_resident(real);
+    if (counters != NULL) {
+        __sync_fetch_and_add(hit ? &counters->hits : &counters->misses, 1);
+    }
+
+    std::string log = residency_dir + "/access.log";
+    int fd = open(log.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return hit;
+    }
+    std::string line = std::string(real) + "\n";
+    if (write(fd, line.c_str(), line.size()) < 0) {   //一次O_APPEND写入，多进程不会交错
+        FM_LOG_WARNING("write residency access log failed, %d: %s", errno, strerror(errno));
+    }
+    close(fd);
+    return hit;
+}
+
+/*
+ * 管理进程中一个被锁定的文件
+ */
+struct resident_file {
+    void *addr;
+    size_t size;
+};
+
+/*
+ * 是否是测试数据文件：in.in、out.out、in<i>.in、out<i>.out，可以带压缩后缀
+ */
+static
+bool is_test_data_name(std::string name) {
+    size_t dot = name.rfind('.');
+    if (dot != std::string::npos && (name.substr(dot) == ".zst" || name.substr(dot) == ".lz4")) {
+        name = name.substr(0, dot);
+    }
+    const char *kinds[2][2] = {{"in", ".in"}, {"out", ".out"}};
+    for (int k = 0; k < 2; k++) {
+        std::string prefix = kinds[k][0], suffix = kinds[k][1];
+        if (name.size() < prefix.size() + suffix.size() ||
+            name.compare(0, prefix.size(), prefix) != 0 ||
+            name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0) {
+            continue;
+        }
+        std::string id = name.substr(prefix.size(), name.size() - prefix.size() - suffix.size());
+        if (id.find_first_not_of("0123456789") == std::string::npos) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * 把题目目录下的测试数据加入预热列表
+ */
+static
+void residency_warm(const std::string &dir, std::map<std::string, double> &freq) {
+    DIR *dp = opendir(dir.c_str());
+    if (dp == NULL) {
+        FM_LOG_WARNING("Cannot warm %s, %d: %s", dir.c_str(), errno, strerror(errno));
+        return;
+    }
+    struct dirent *ent;
+    while ((ent = readdir(dp)) != NULL) {
+        std::string name = ent->d_name;
+        if (is_test_data_name(name)) {
+            char real[PATH_MAX];
+            std::string path = dir + "/" + name;
+            if (realpath(path.c_str(), real) != NULL) {
+                freq[real] = RESIDENCY_WARM_FREQ;
+            }
+        }
+    }
+    closedir(dp);
+}
+
+/*
+ * 读走访问日志，累加到频率表
+ */
+static
+void residency_collect(std::map<std::string, double> &freq) {
+    for (std::map<std::string, double>::iterator it = freq.begin(); it != freq.end();) {
+        it->second *= RESIDENCY_DECAY;
+        if (it->second < RESIDENCY_MIN_FREQ) {
+            freq.erase(it++);   //很久没人访问了
+        } else {
+            ++it;
+        }
+    }
+
+    std::string log = residency_dir + "/access.log";
+    std::string work = log + ".work";
+    if (rename(log.c_str(), work.c_str()) < 0) {
+        return;
+    }
+    FILE *fp = fopen(work.c_str(), "r");
+    if (fp == NULL) {
+        return;
+    }
+    char line[PATH_MAX + 2];
+    while (fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\n")] = 0;
+        if (line[0]) freq[line] += 1;
+    }
+    fclose(fp);
+    unlink(work.c_str());
+}
+
+/*
+ * 按频率在预算内重新选择常驻文件
+ */
+static
+void residency_rebalance(const std::map<std::string, double> &freq, size_t budget,
+        std::map<std::string, resident_file> &resident) {
+    std::vector<std::pair<double, std::string> > order;
+    for (std::map<std::string, double>::const_iterator it = freq.begin(); it != freq.end(); ++it) {
+        order.push_back(std::make_pair(-it->second, it->first));
+    }
+    std::sort(order.begin(), order.end());
+
+    std::map<std::string, bool> keep;
+    size_t used = 0;
+    for (size_t i = 0; i < order.size(); i++) {
+        struct stat st;
+        if (stat(order[i].second.c_str(), &st) < 0 || st.st_size == 0) continue;
+        if (used + st.st_size > budget) continue;  //放不下就看下一个更小的
+        used += st.st_size;
+        keep[order[i].second] = true;
+    }
+
+    //先释放被挤出去的，再锁定新选中的
+    for (std::map<std::string, resident_file>::iterator it = resident.begin(); it != resident.end();) {
+        if (keep.count(it->first)) {
+            ++it;
+            continue;
+        }
+        munlock(it->second.addr, it->second.size);
+        munmap(it->second.addr, it->second.size);
+        FM_LOG_TRACE("residency: evict %s", it->first.c_str());
+        resident.erase(it++);
+    }
+    for (std::map<std::string, bool>::iterator it = keep.begin(); it != keep.end(); ++it) {
+        if (resident.count(it->first)) continue;
+        int fd = open(it->first.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) continue;
+        struct stat st;
+        fstat(fd, &st);
+        void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) continue;
+        if (mlock(p, st.st_size) < 0) {
+            FM_LOG_WARNING("mlock(%s) failed, %d: %s", it->first.c_str(), errno, strerror(errno));
+            munmap(p, st.st_size);
+            continue;
+        }
+        resident_file f = {p, (size_t)st.st_size};
+        resident[it->first] = f;
+        FM_LOG_TRACE("residency: lock %s", it->first.c_str());
+    }
+}
+
+static
+void residency_write_status(const std::map<std::string, resident_file> &resident,
+        const std::map<std::string, double> &freq, residency_counters *counters) {
+    std::string path = residency_dir + "/status";
+    std::string tmp = path + ".tmp";
+    FILE *fp = fopen(tmp.c_str(), "w");
+    if (fp == NULL) {
+        return;
+    }
+    size_t total = 0;
+    for (std::map<std::string, resident_file>::const_iterator it = resident.begin(); it != resident.end(); ++it) {
+        total += it->second.size;
+    }
+    fprintf(fp, "hits %llu\n", counters ? counters->hits : 0ULL);
+    fprintf(fp, "misses %llu\n", counters ? counters->misses : 0ULL);
+    fprintf(fp, "resident_bytes %zu\n", total);
+    fprintf(fp, "resident_files %zu\n", resident.size());
+    for (std::map<std::string, resident_file>::const_iterator it = resident.begin(); it != resident.end(); ++it) {
+        fprintf(fp, "%s %zu %.2f\n", it->first.c_str(), it->second.size, freq.find(it->first)->second);
+    }
+    fclose(fp);
+    rename(tmp.c_str(), path.c_str());
+}
+
+/*
+ * 管理进程的主循环，不会返回
+ */
+void residency_manager(size_t budget, const std::vector<std::string> &warm_dirs, int interval) {
+    std::map<std::string, double> freq;
+    std::map<std::string, resident_file> resident;
+    residency_counters *counters = residency_map_counters();
+
+    for (size_t i = 0; i < warm_dirs.size(); i++) {
+        residency_warm(warm_dirs[i], freq);
+    }
+    FM_LOG_NOTICE("residency manager started, budget %zu bytes, %d files to warm", budget, (int)freq.size());
+
+    while (true) {
+        residency_collect(freq);
+        residency_rebalance(freq, budget, resident);
+        residency_write_status(resident, freq, counters);
+        sleep(interval);
+    }
+}
+
+#endif
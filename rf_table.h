@@ -140,6 +140,27 @@ int RF_JAVA[512] =
     -1
 };
 
+//多线程模式下追加允许的系统调用，clone是否创建线程以及线程数另外检查
+int RF_THREADS[512] =
+{
+    SYS_clone,          -1,
+    SYS_exit,           -1,
+    SYS_getpid,         -1,
+    SYS_gettid,         -1,
+    SYS_madvise,        -1,
+    SYS_nanosleep,      -1,
+    SYS_clock_nanosleep,-1,
+    SYS_rt_sigaction,   -1,
+    SYS_rt_sigprocmask, -1,
+    SYS_sched_getaffinity, -1,
+    SYS_sched_yield,    -1,
+    SYS_set_robust_list,-1,
+    SYS_sysinfo,        -1,
+    SYS_ugetrlimit,     -1,
+    SYS_prlimit64,      -1,
+    -1
+};
+
 #elif defined __x86_64__
 int RF_C[512] =
 {
@@ -254,6 +275,33 @@ int RF_JAVA[512] =
     SYS_readlink,       -1,
     -1
 };
+
+//多线程模式下追加允许的系统调用，clone是否创建线程以及线程数另外检查
+int RF_THREADS[512] =
+{
+    SYS_clone,          -1,
+#ifdef SYS_clone3
+    SYS_clone3,         -1,
+#endif
+    SYS_exit,           -1,
+    SYS_getpid,         -1,
+    SYS_gettid,         -1,
+    SYS_madvise,        -1,
+    SYS_nanosleep,      -1,
+    SYS_clock_nanosleep,-1,
+    SYS_rt_sigaction,   -1,
+    SYS_rt_sigprocmask, -1,
+#ifdef SYS_rseq
+    SYS_rseq,           -1,
+#endif
+    SYS_sched_getaffinity, -1,
+    SYS_sched_yield,    -1,
+    SYS_set_robust_list,-1,
+    SYS_sysinfo,        -1,
+    SYS_getrlimit,      -1,
+    SYS_prlimit64,      -1,
+    -1
+};
 #endif
 
 //根据 RF_* 数组来初始化RF_table
@@ -285,4 +333,13 @@ void init_RF_table(int lang)
     }
 }
 
+//多线程模式，在init_RF_table之后调用
+void allow_threads()
+{
+    for (int i = 0; RF_THREADS[i] >= 0; i += 2)
+    {
+        RF_table[RF_THREADS[i]] = RF_THREADS[i+1];
+    }
+}
+
 #endif
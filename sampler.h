@@ -0,0 +1,186 @@
+#ifndef __SAMPLER__
+#define __SAMPLER__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <string>
+
+#include "logger.h"
+
+/*
+ * 用户程序运行过程中的资源采样
+ * 评测只报告一个内存峰值，TLE、MLE时连这个都清零了。采样进程每隔一段时间读一次
+ * /proc/<pid>/stat和/proc/<pid>/status，记下RSS、VmHWM、CPU时间和缺页次数，
+ * 运行结束后追加到运行目录下的samples.txt，不论结果如何都保留。
+ *
+ * 采样进程和跟踪进程分开，不增加用户程序的停顿；两个/proc文件一直开着，每次用pread从头读。
+ * 样本存在预先分配的缓冲区里，满了就隔一个丢一个，采样间隔加倍，这样总能覆盖整个运行过程。
+ * 跟踪进程关闭管道的写端表示运行结束，采样进程用poll等待，超时就是采样间隔
+ */
+const int SAMPLE_MAX = 4096;    //缓冲区最多存多少个样本
+
+struct sample {
+    int time_ms;        //从开始运行算起
+    int cpu_ms;         //用户态加内核态，所有线程之和
+    int rss_kb;
+    int hwm_kb;         //VmHWM，RSS的峰值
+    long long minflt;
+    long long majflt;
+};
+
+/*
+ * 读一个样本，进程已经不在时返回false
+ */
+static
+bool sampler_read(int stat_fd, int status_fd, long ticks, long page_kb, sample &s) {
+    char buf[2048];
+    ssize_t len = pread(stat_fd, buf, sizeof(buf) - 1, 0);
+    if (len <= 0) {
+        return false;
+    }
+    buf[len] = 0;
+    //进程名里可能有空格和括号，从最后一个')'之后开始数
+    char *p = strrchr(buf, ')');
+    unsigned long long minflt, majflt, utime, stime;
+    long long rss;
+    if (p == NULL || 5 != sscanf(p + 2,
+            "%*c %*d %*d %*d %*d %*d %*u %llu %*u %llu %*u %llu %llu %*d %*d %*d %*d %*d %*d %*s %*s %lld",
+            &minflt, &majflt, &utime, &stime, &rss)) {
+        return false;
+    }
+    s.cpu_ms = (int)((utime + stime) * 1000 / ticks);
+    s.rss_kb = (int)(rss * page_kb);
+    s.minflt = minflt;
+    s.majflt = majflt;
+
+    s.hwm_kb = 0;
+    len = pread(status_fd, buf, sizeof(buf) - 1, 0);
+    if (len > 0) {
+        buf[len] = 0;
+        p = strstr(buf, "VmHWM:");
+        if (p != NULL) {
+            s.hwm_kb = atoi(p + 6);
+        }
+    }
+    return true;
+}
+
+/*
+ * 采样进程：每隔interval_ms读一次pid的用量，stop_fd可读（写端关闭）或进程消失时
+ * 把样本追加到path，每行：组号 时间(ms) CPU时间(ms) RSS(KB) VmHWM(KB) 次缺页 主缺页
+ */
+static
+void sampler_main(pid_t pid, int case_no, int interval_ms, int stop_fd, const std::string &path) {
+    static sample samples[SAMPLE_MAX];
+    int count = 0;
+
+    char name[64];
+    snprintf(name, sizeof(name), "/proc/%d/stat", (int)pid);
+    int stat_fd = open(name, O_RDONLY | O_CLOEXEC);
+    snprintf(name, sizeof(name), "/proc/%d/status", (int)pid);
+    int status_fd = open(name, O_RDONLY | O_CLOEXEC);
+    long ticks = sysconf(_SC_CLK_TCK);
+    long page_kb = sysconf(_SC_PAGESIZE) / 1024;
+
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    struct pollfd stop = {stop_fd, POLLIN, 0};
+    int interval = interval_ms;
+    long long next_ms = 0;
+
+    while (stat_fd >= 0 && status_fd >= 0) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long long elapsed = (now.tv_sec - start.tv_sec) * 1000LL + (now.tv_nsec - start.tv_nsec) / 1000000;
+        if (elapsed >= next_ms) {
+            sample s;
+            if (!sampler_read(stat_fd, status_fd, ticks, page_kb, s)) {
+                break;
+            }
+            s.time_ms = (int)elapsed;
+            if (count == SAMPLE_MAX) {
+                //隔一个丢一个，保留第一个样本
+                for (int i = 1; i < SAMPLE_MAX / 2; i++) {
+                    samples[i] = samples[i * 2];
+                }
+                count = SAMPLE_MAX / 2;
+                interval *= 2;
+            }
+            samples[count++] = s;
+            next_ms = elapsed + interval;
+        }
+        if (poll(&stop, 1, (int)(next_ms - elapsed > 0 ? next_ms - elapsed : 0)) != 0) {
+            break;  //运行结束
+        }
+    }
+
+    std::string text;
+    char line[128];
+    for (int i = 0; i < count; i++) {
+        const sample &s = samples[i];
+        snprintf(line, sizeof(line), "%d %d %d %d %d %lld %lld\n", case_no, s.time_ms, s.cpu_ms,
+                s.rss_kb, s.hwm_kb, s.minflt, s.majflt);
+        text += line;
+    }
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0 || write(fd, text.c_str(), text.size()) != (ssize_t)text.size()) {
+        FM_LOG_WARNING("write samples %s failed, %d: %s", path.c_str(), errno, strerror(errno));
+    }
+    _exit(EXIT_SUCCESS);    //不能触发atexit，否则会写result.txt
+}
+
+/*
+ * 启动采样进程，stop_fd返回管道的写端，关闭它让采样进程结束
+ * avoid不为NULL时采样进程避开其中的CPU（用户程序所在的全部CPU），至少留一个CPU
+ */
+pid_t spawn_sampler(pid_t pid, int case_no, int interval_ms, const std::string &path,
+        const cpu_set_t *avoid, int &stop_fd) {
+    int fds[2];
+    stop_fd = -1;
+    if (pipe2(fds, O_CLOEXEC) < 0) {
+        FM_LOG_WARNING("pipe for sampler failed, %d: %s", errno, strerror(errno));
+        return -1;
+    }
+    pid_t sampler = fork();
+    if (sampler < 0) {
+        FM_LOG_WARNING("fork for sampler failed, %d: %s", errno, strerror(errno));
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    } else if (sampler == 0) {
+        close(fds[1]);
+        cpu_set_t mask, rest;
+        if (avoid != NULL && sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+            CPU_XOR(&rest, &mask, avoid);
+            CPU_AND(&rest, &rest, &mask);
+            if (CPU_COUNT(&rest) > 0) {
+                sched_setaffinity(0, sizeof(rest), &rest);
+            }
+        }
+        sampler_main(pid, case_no, interval_ms, fds[0], path);
+    }
+    close(fds[0]);
+    stop_fd = fds[1];
+    return sampler;
+}
+
+/*
+ * 让采样进程写出样本并结束
+ */
+void finish_sampler(pid_t sampler, int stop_fd) {
+    if (sampler <= 0) {
+        return;
+    }
+    close(stop_fd);
+    waitpid(sampler, NULL, 0);
+}
+
+#endif
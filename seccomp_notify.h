@@ -0,0 +1,173 @@
+#ifndef __SECCOMP_NOTIFY__
+#define __SECCOMP_NOTIFY__
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "logger.h"
+
+/*
+ * 不用ptrace，用seccomp的用户通知监控用户程序
+ * 子进程在exec之前装上BPF过滤器：RF_table中不限次数的系统调用直接在内核里执行，
+ * 其余的（限次数的、要检查路径的、不允许的）挂起，通过通知fd交给评测进程决定，
+ * 允许时让内核接着执行（SECCOMP_USER_NOTIF_FLAG_CONTINUE），不允许时杀掉用户程序。
+ * 用户程序平时不停下，评测进程只需要poll通知fd，可以和其他fd一起等待。
+ *
+ * 通知fd在子进程里创建，子进程把fd号写进管道，评测进程用pidfd_getfd取过来；
+ * 子进程的fd带O_CLOEXEC，exec之后用户程序手里没有它
+ */
+#if defined __x86_64__
+const unsigned int SECCOMP_NOTIFY_ARCH = AUDIT_ARCH_X86_64;
+#else
+const unsigned int SECCOMP_NOTIFY_ARCH = AUDIT_ARCH_I386;
+#endif
+
+/*
+ * 内核是否支持用户通知和pidfd_getfd（5.6以后）
+ */
+bool seccomp_notify_available() {
+    unsigned int action = SECCOMP_RET_USER_NOTIF;
+    if (syscall(SYS_seccomp, SECCOMP_GET_ACTION_AVAIL, 0, &action) < 0) {
+        return false;
+    }
+    return syscall(SYS_pidfd_getfd, -1, 0, 0) < 0 && errno != ENOSYS;
+}
+
+/*
+ * 在子进程中按系统调用表装上过滤器，返回通知fd，失败返回-1
+ * table[i] < 0表示不限制，直接放行；其余都交给评测进程。
+ * notify中的系统调用（以-1结尾）不论表中是什么都交给评测进程
+ */
+int seccomp_notify_install(const short *table, int size, const int *notify) {
+    std::vector<struct sock_filter> prog;
+    struct sock_filter arch[] = {
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, arch)),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, SECCOMP_NOTIFY_ARCH, 1, 0),
+        BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_KILL_PROCESS),
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, nr)),
+    };
+    prog.insert(prog.end(), arch, arch + sizeof(arch) / sizeof(arch[0]));
+    for (int nr = 0; nr < size; nr++) {
+        if (table[nr] >= 0) continue;
+        bool always = false;
+        for (int i = 0; notify[i] >= 0; i++) {
+            always = always || notify[i] == nr;
+        }
+        if (always) continue;
+        struct sock_filter allow[] = {
+            BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, (unsigned int)nr, 0, 1),
+            BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW),
+        };
+        prog.insert(prog.end(), allow, allow + 2);
+    }
+    struct sock_filter rest = BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_USER_NOTIF);
+    prog.push_back(rest);
+
+    struct sock_fprog fprog;
+    fprog.len = prog.size();
+    fprog.filter = &prog[0];
+    //setuid之后没有CAP_SYS_ADMIN，必须先禁止获得新权限
+    if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) < 0) {
+        return -1;
+    }
+    return syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER, SECCOMP_FILTER_FLAG_NEW_LISTENER, &fprog);
+}
+
+/*
+ * 评测进程中取得子进程的通知fd，sync_fd是子进程写入fd号的管道
+ * 子进程在写入之前就失败退出时返回-1
+ */
+int seccomp_notify_attach(pid_t pid, int sync_fd, int &pidfd) {
+    int child_fd = -1;
+    pidfd = syscall(SYS_pidfd_open, pid, 0);
+    if (pidfd < 0) {
+        FM_LOG_WARNING("pidfd_open(%d) failed, %d: %s", (int)pid, errno, strerror(errno));
+        return -1;
+    }
+    if (read(sync_fd, &child_fd, sizeof(child_fd)) != sizeof(child_fd)) {
+        return -1;
+    }
+    int fd = syscall(SYS_pidfd_getfd, pidfd, child_fd, 0);
+    if (fd < 0) {
+        FM_LOG_WARNING("pidfd_getfd(%d) failed, %d: %s", child_fd, errno, strerror(errno));
+    }
+    return fd;
+}
+
+/*
+ * 接收一个通知，req和resp要足够大（见seccomp_notify_sizes）
+ */
+bool seccomp_notify_recv(int listener, struct seccomp_notif *req, size_t size) {
+    memset(req, 0, size);   //内核要求清零
+    while (ioctl(listener, SECCOMP_IOCTL_NOTIF_RECV, req) < 0) {
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * 回复通知：allow为true时让内核照常执行这个系统调用，否则返回EPERM
+ * 用户程序已经不在时（比如被信号杀掉）回复失败，忽略即可
+ */
+void seccomp_notify_reply(int listener, struct seccomp_notif_resp *resp, size_t size,
+        unsigned long long id, bool allow) {
+    memset(resp, 0, size);
+    resp->id = id;
+    if (allow) {
+        resp->flags = SECCOMP_USER_NOTIF_FLAG_CONTINUE;
+    } else {
+        resp->error = -EPERM;
+    }
+    ioctl(listener, SECCOMP_IOCTL_NOTIF_SEND, resp);
+}
+
+/*
+ * 读用户程序内存中的字符串（比如open的路径），读完再确认通知仍然有效，
+ * 防止这期间进程已经换成了别的
+ */
+bool seccomp_notify_string(int listener, unsigned long long id, pid_t pid,
+        unsigned long long addr, char *buf, size_t size) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/mem", (int)pid);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    ssize_t len = pread(fd, buf, size - 1, addr);
+    close(fd);
+    if (len <= 0 || ioctl(listener, SECCOMP_IOCTL_NOTIF_ID_VALID, &id) < 0) {
+        return false;
+    }
+    buf[len] = 0;   //路径比缓冲区长时截断，和ptrace读路径时一样
+    return true;
+}
+
+/*
+ * 内核中通知结构的大小，可能比头文件中的大
+ */
+void seccomp_notify_sizes(size_t &req, size_t &resp) {
+    struct seccomp_notif_sizes sizes;
+    req = sizeof(struct seccomp_notif);
+    resp = sizeof(struct seccomp_notif_resp);
+    if (syscall(SYS_seccomp, SECCOMP_GET_NOTIF_SIZES, 0, &sizes) == 0) {
+        req = std::max(req, (size_t)sizes.seccomp_notif);
+        resp = std::max(resp, (size_t)sizes.seccomp_notif_resp);
+    }
+}
+
+#endif
@@ -0,0 +1,165 @@
+#ifndef __TRACE__
+#define __TRACE__
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include <string>
+
+#include "core.h"
+#include "logger.h"
+
+/*
+ * 单次评测的时间线，导出为Chrome/Perfetto的trace event JSON
+ *
+ * 事件记录在预先分配好的共享映射里，fork出的编译器、用户程序（exec之前）、SPJ
+ * 子进程都往同一块缓冲区追加，记录一次只是一次原子加和几次内存写，
+ * 不做格式化、不分配内存、不产生系统调用（时间由vDSO读取），
+ * 缓冲区满了就丢弃并计数，最后由评测进程在退出时统一写成JSON。
+ *
+ * 缓冲区是运行目录下的文件，批量评测时后面的阶段进程接着前面的记录。
+ */
+const int TRACE_EVENTS = 16384;
+
+struct trace_event {
+    long long ts;       //CLOCK_MONOTONIC, ns
+    int pid;
+    int arg;
+    char ph;            //B 开始, E 结束, i 瞬时
+    char name[23];
+    char arg_name[8];   //为空表示没有参数
+};
+
+struct trace_buffer {
+    unsigned int count;
+    unsigned int dropped;
+    trace_event events[TRACE_EVENTS];
+};
+
+static trace_buffer *trace = NULL;
+static pid_t trace_owner = -1;  //只有调用trace_init的进程负责导出
+static pid_t trace_pid = 0;     //缓存getpid()，fork后在子进程里清零
+
+static void trace_forget_pid() {
+    trace_pid = 0;
+}
+
+/*
+ * 映射缓冲区文件，reset为true时清空之前的记录
+ */
+bool trace_init(const std::string &path, bool reset) {
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    if (ftruncate(fd, sizeof(trace_buffer)) < 0) {
+        close(fd);
+        return false;
+    }
+    void *p = mmap(NULL, sizeof(trace_buffer), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    //先把每一页写一遍，评测过程中记录事件不再触发缺页
+    volatile char *page = (volatile char *)p;
+    for (size_t off = 0; off < sizeof(trace_buffer); off += getpagesize()) {
+        page[off] = page[off];
+    }
+    trace = (trace_buffer *)p;
+    if (reset) {
+        trace->count = 0;
+        trace->dropped = 0;
+    }
+    trace_owner = getpid();
+    static bool registered = false;
+    if (!registered) {
+        pthread_atfork(NULL, NULL, trace_forget_pid);
+        registered = true;
+    }
+    return true;
+}
+
+static void trace_add(char ph, const char *name, const char *arg_name, int arg) {
+    if (trace == NULL) {
+        return;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    unsigned int i = __sync_fetch_and_add(&trace->count, 1);
+    if (i >= (unsigned int)TRACE_EVENTS) {
+        __sync_fetch_and_add(&trace->dropped, 1);
+        return;
+    }
+    trace_event &e = trace->events[i];
+    e.ts = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    if (trace_pid == 0) {
+        trace_pid = getpid();
+    }
+    e.pid = trace_pid;
+    e.arg = arg;
+    e.ph = ph;
+    strncpy(e.name, name, sizeof(e.name) - 1);
+    e.name[sizeof(e.name) - 1] = 0;
+    strncpy(e.arg_name, arg_name, sizeof(e.arg_name) - 1);
+    e.arg_name[sizeof(e.arg_name) - 1] = 0;
+}
+
+void trace_begin(const char *name, const char *arg_name = "", int arg = 0) {
+    trace_add('B', name, arg_name, arg);
+}
+
+void trace_end(const char *name) {
+    trace_add('E', name, "", 0);
+}
+
+void trace_instant(const char *name, const char *arg_name = "", int arg = 0) {
+    trace_add('i', name, arg_name, arg);
+}
+
+/*
+ * 把缓冲区写成JSON（先写临时文件再rename），然后删掉缓冲区文件
+ */
+void trace_export(const std::string &path, const std::string &buffer_path) {
+    if (trace == NULL || getpid() != trace_owner) {
+        return;
+    }
+    std::string tmp = path + ".tmp";
+    FILE *fp = fopen(tmp.c_str(), "w");
+    if (fp == NULL) {
+        FM_LOG_WARNING("Cannot write trace %s, %d: %s", tmp.c_str(), errno, strerror(errno));
+        return;
+    }
+    unsigned int n = trace->count < (unsigned int)TRACE_EVENTS ? trace->count : TRACE_EVENTS;
+    fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"otherData\":{\"dropped\":%u},\"traceEvents\":[", trace->dropped);
+    for (unsigned int i = 0; i < n; i++) {
+        const trace_event &e = trace->events[i];
+        fprintf(fp, "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%lld.%03lld,\"pid\":%d,\"tid\":%d",
+                i ? "," : "", e.name, e.ph, e.ts / 1000, e.ts % 1000, e.pid, e.pid);
+        if (e.ph == 'i') {
+            fprintf(fp, ",\"s\":\"t\"");
+        }
+        if (e.arg_name[0]) {
+            fprintf(fp, ",\"args\":{\"%s\":%d}", e.arg_name, e.arg);
+        }
+        fprintf(fp, "}");
+    }
+    fprintf(fp, "\n]}\n");
+    fclose(fp);
+
+    if (rename(tmp.c_str(), path.c_str()) < 0) {
+        FM_LOG_WARNING("rename trace %s failed, %d: %s", path.c_str(), errno, strerror(errno));
+        unlink(tmp.c_str());
+    }
+    munmap(trace, sizeof(trace_buffer));
+    trace = NULL;
+    unlink(buffer_path.c_str());
+}
+
+#endif
@@ -0,0 +1,198 @@
+#ifndef __VERDICT_CACHE__
+#define __VERDICT_CACHE__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "logger.h"
+
+/*
+ * 按测试数据缓存评测结果
+ * 键由以下内容的哈希组成：
+ *   编译出的可执行文件（Java是所有.class文件）、输入文件、标准输出文件、
+ *   时间限制、内存限制、比对方式（普通比对或SpecialJudge程序本身）、
+ *   多线程、扣除停顿开销、监控方式（Landlock、seccomp）、JudgeRunner等选项
+ * 重判时键没有变化的测试数据直接取缓存的结果、时间和内存
+ *
+ * 缓存目录下：
+ *   v/<键的前两位>/<键>    一行"结果 时间 内存"
+ *   f/<设备号>_<inode号>  一行"修改时间(ns) 大小 哈希"，避免每次都重新哈希GB级的数据文件
+ */
+typedef unsigned long long cache_hash;
+
+const cache_hash FNV_OFFSET = 14695981039346656037ULL;
+const cache_hash FNV_PRIME  = 1099511628211ULL;
+
+static std::string cache_dir;
+
+static
+cache_hash hash_bytes(cache_hash h, const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char *)data;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ p[i]) * FNV_PRIME;
+    }
+    return h;
+}
+
+static
+bool make_dirs(const std::string &path) {
+    for (size_t i = 1; i <= path.size(); i++) {
+        if (i == path.size() || path[i] == '/') {
+            std::string dir = path.substr(0, i);
+            if (mkdir(dir.c_str(), 0755) < 0 && errno != EEXIST) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/*
+ * 原子地写入一个小文件：先写临时文件再rename
+ */
+static
+void cache_write(const std::string &path, const char *content) {
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".tmp.%d", (int)getpid());
+    std::string tmp = path + suffix;
+    FILE *fp = fopen(tmp.c_str(), "w");
+    if (fp == NULL) {
+        return;
+    }
+    fputs(content, fp);
+    fclose(fp);
+    if (rename(tmp.c_str(), path.c_str()) < 0) {
+        unlink(tmp.c_str());
+    }
+}
+
+bool verdict_cache_init(const std::string &dir) {
+    cache_dir = dir;
+    return make_dirs(cache_dir + "/v") && make_dirs(cache_dir + "/f");
+}
+
+/*
+ * 只在dir/f下记忆数据文件的哈希，不缓存评测结果，给只用到哈希的功能
+ */
+bool hash_memo_init(const std::string &dir) {
+    cache_dir = dir;
+    return make_dirs(cache_dir + "/f");
+}
+
+/*
+ * 文件内容的哈希，文件不存在时返回0
+ */
+cache_hash hash_file(const std::string &path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) < 0) {
+        return 0;
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "/f/%llx_%llx",
+            (unsigned long long)st.st_dev, (unsigned long long)st.st_ino);
+    std::string memo = cache_dir + name;
+    long long now_mtime = (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    long long mtime = 0, size = 0;
+    cache_hash h = 0;
+    FILE *fp = cache_dir.empty() ? NULL : fopen(memo.c_str(), "r");   //没有缓存目录时不记录
+    if (fp != NULL) {
+        int n = fscanf(fp, "%lld %lld %llx", &mtime, &size, &h);
+        fclose(fp);
+        if (n == 3 && mtime == now_mtime && size == (long long)st.st_size) {
+            return h;
+        }
+    }
+
+    fp = fopen(path.c_str(), "rb");
+    if (fp == NULL) {
+        return 0;
+    }
+    h = FNV_OFFSET;
+    char buffer[65536];
+    size_t len;
+    while ((len = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+        h = hash_bytes(h, buffer, len);
+    }
+    fclose(fp);
+
+    char content[128];
+    snprintf(content, sizeof(content), "%lld %lld %llx\n",
+            now_mtime, (long long)st.st_size, h);
+    if (!cache_dir.empty()) {
+        cache_write(memo, content);
+    }
+    return h;
+}
+
+/*
+ * 目录下所有某后缀文件的哈希，按文件名排序后连同文件名一起哈希
+ */
+cache_hash hash_files_with_suffix(const std::string &dir, const std::string &suffix) {
+    std::vector<std::string> names;
+    DIR *dp = opendir(dir.c_str());
+    if (dp == NULL) {
+        return 0;
+    }
+    struct dirent *ent;
+    while ((ent = readdir(dp)) != NULL) {
+        std::string name = ent->d_name;
+        if (name.size() > suffix.size() &&
+            name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0) {
+            names.push_back(name);
+        }
+    }
+    closedir(dp);
+    std::sort(names.begin(), names.end());
+
+    cache_hash h = FNV_OFFSET;
+    for (size_t i = 0; i < names.size(); i++) {
+        cache_hash file = hash_file(dir + "/" + names[i]);
+        h = hash_bytes(h, names[i].c_str(), names[i].size() + 1);
+        h = hash_bytes(h, &file, sizeof(file));
+    }
+    return h;
+}
+
+cache_hash hash_combine(cache_hash h, cache_hash value) {
+    return hash_bytes(h, &value, sizeof(value));
+}
+
+static
+std::string verdict_path(cache_hash key) {
+    char name[64];
+    snprintf(name, sizeof(name), "/v/%02llx/%016llx", key >> 56, key);
+    return cache_dir + name;
+}
+
+bool verdict_cache_get(cache_hash key, int &result, int &time_usage, int &memory_usage) {
+    FILE *fp = fopen(verdict_path(key).c_str(), "r");
+    if (fp == NULL) {
+        return false;
+    }
+    int n = fscanf(fp, "%d %d %d", &result, &time_usage, &memory_usage);
+    fclose(fp);
+    return n == 3;
+}
+
+void verdict_cache_put(cache_hash key, int result, int time_usage, int memory_usage) {
+    std::string path = verdict_path(key);
+    if (!make_dirs(path.substr(0, path.rfind('/')))) {
+        FM_LOG_WARNING("Create verdict cache dir for %s failed", path.c_str());
+        return;
+    }
+    char content[64];
+    snprintf(content, sizeof(content), "%d %d %d\n", result, time_usage, memory_usage);
+    cache_write(path, content);
+}
+
+#endif